@@ -15,4 +15,51 @@ void ast_add_func(AST_Program *p, AST_FuncDecl f) {
         // could wrap realloc with check and grow helper
     }
     p->funcs[p->func_count++] = f;
+}
+
+// post-order walk over every expression under e
+void ast_visit_expr(AST_Expr *e, AST_ExprFn fn, void *ctx) {
+    switch (e->kind) {
+    case EXPR_BIN: ast_visit_expr(e->bin.left, fn, ctx); ast_visit_expr(e->bin.right, fn, ctx); break;
+    case EXPR_CMP: ast_visit_expr(e->cmp.left, fn, ctx); ast_visit_expr(e->cmp.right, fn, ctx); break;
+    case EXPR_CALL: case EXPR_SPAWN: case EXPR_BUILTIN:
+        for (int i=0;i<e->call.arg_count;i++) ast_visit_expr(e->call.args[i], fn, ctx);
+        break;
+    case EXPR_INDEX: ast_visit_expr(e->index.at, fn, ctx); break;
+    case EXPR_JOIN: ast_visit_expr(e->join, fn, ctx); break;
+    default: break;
+    }
+    fn(e, ctx);
+}
+
+// every expression in a block, statements in source order
+void ast_visit_block(AST_Block b, AST_ExprFn fn, void *ctx) {
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        switch (s->kind) {
+        case STMT_VAR: if (s->var.init) ast_visit_expr(s->var.init, fn, ctx); break;
+        case STMT_ASSIGN:
+            if (s->assign.index) ast_visit_expr(s->assign.index, fn, ctx);
+            ast_visit_expr(s->assign.expr, fn, ctx);
+            break;
+        case STMT_IF:
+            ast_visit_expr(s->if_.cond, fn, ctx);
+            ast_visit_block(s->if_.then, fn, ctx);
+            ast_visit_block(s->if_.else_, fn, ctx);
+            break;
+        case STMT_WHILE:
+            ast_visit_expr(s->while_.cond, fn, ctx);
+            ast_visit_block(s->while_.body, fn, ctx);
+            break;
+        case STMT_PFOR:
+            ast_visit_expr(s->pfor.lo, fn, ctx);
+            ast_visit_expr(s->pfor.hi, fn, ctx);
+            ast_visit_block(s->pfor.body, fn, ctx);
+            break;
+        case STMT_PRINT: ast_visit_expr(s->print, fn, ctx); break;
+        case STMT_RETURN: if (s->ret) ast_visit_expr(s->ret, fn, ctx); break;
+        case STMT_FREE: break;
+        case STMT_EXPR: ast_visit_expr(s->expr, fn, ctx); break;
+        }
+    }
 }
\ No newline at end of file
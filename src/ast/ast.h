@@ -15,6 +15,10 @@ typedef struct AST_Block {
 typedef struct {
     Type type;
     bool manual; // mark for manual memory mgmt
+    bool task;    // task handle, type is the result of the spawned function
+    bool escapes; // value may be read after its frame or producer is gone
+    bool outlives; // value may be read after the function returns
+    int len;      // > 0: array of len elements of type, zero-initialised
     const char *name;
     AST_Expr *init;
 } AST_VarDecl; // add const/readonly flags later
@@ -22,9 +26,18 @@ typedef struct {
 // function param node
 typedef struct {
     Type type;
+    bool escapes; // callee may let the argument outlive the call
+    bool outlives; // callee may let the argument outlive its caller
     const char *name;
 } AST_Param; // can add default values support later
 
+// what a function may do besides computing its result, see opt/purity.c
+typedef enum {
+    PURITY_NONE,   // side effects: prints, allocates, may abort or not return
+    PURITY_PURE,   // reads memory reachable from its arguments, no effects
+    PURITY_CONST,  // result depends on argument values only
+} Purity;
+
 // function decl node
 typedef struct AST_FuncDecl {
     const char *name;
@@ -32,50 +45,129 @@ typedef struct AST_FuncDecl {
     int param_count;
     Type ret_ty;
     AST_Block body;
-} AST_FuncDecl; // need support for extern funcs and attributes
+    int line;
+    bool memo;       // @memo, or picked by --memo: results cached per argument tuple
+    Purity purity;   // filled in by purity_analyze
+    bool recursive;  // can reach a call to itself, set by purity_analyze
+    uint64_t calls;  // --profile-use: times called
+    bool hot, cold;  // --profile-use: among the most called / never called
+} AST_FuncDecl; // need support for extern funcs
+
+// an if or while condition, numbered for profiling, see opt/profile.c
+typedef struct {
+    const char *func;  // function the statement was written in
+    int ordinal;       // nth if/while of func in source order
+    int line;
+    int expect;        // --profile-use: 1 likely true, -1 likely false, 0 unknown
+} AST_Branch;
 
 // full program node
 typedef struct AST_Program {
     AST_FuncDecl *funcs;
     int func_count, cap;
+    AST_Branch *branches;  // indexed by AST_Stmt.branch, entry 0 unused
+    int branch_count;
 } AST_Program; // should support global vars too
 
 /* expressions */
 
 // kinds of expressions
 typedef enum {
-    EXPR_INT, EXPR_STR, EXPR_IDENT, EXPR_BIN, EXPR_CMP, EXPR_CALL
+    EXPR_INT, EXPR_STR, EXPR_IDENT, EXPR_BIN, EXPR_CMP, EXPR_CALL, EXPR_INDEX,
+    EXPR_SPAWN,  // spawn f(args): the call runs as a task, fields in call
+    EXPR_JOIN,   // join(t): waits for task t and yields its result
+    EXPR_FLOAT,  // float literal, double unless its context makes it float
+    EXPR_BUILTIN,  // T(args) conversion or vector construction, hsum/hmin/hmax(v);
+                   // fields in call, name is the type or builtin
 } ExprKind; // add unary ops and member access later
 
 // expression node
 struct AST_Expr {
     ExprKind kind;
+    int line;      // source line, for diagnostics and profiling
+    int site;      // heap profile allocation site, 0 = untracked
+    Type ty;       // filled in by sema
+    bool no_escape; // allocation provably dies with the frame
+    bool in_region; // result stored into a manual var, allocate from the region
+    bool chained;  // string '+' operand of another '+', fused into its allocation
+    int buf;       // codegen: stack buffer for a no_escape allocation, 0 = heap
     union {
         int int_lit;
+        double float_lit;
         const char *str_lit;
         const char *ident;
         struct { int op; AST_Expr *left, *right; } bin;
         struct { int cmp; AST_Expr *left, *right; } cmp;
         struct { const char *name; AST_Expr **args; int arg_count; } call;
+        AST_Expr *join;  // task variable or element of a task array
+        struct {
+            const char *name; AST_Expr *at;
+            int len;        // filled in by sema
+            bool unchecked; // range analysis proved 0 <= at < len
+            bool lane;      // lane of a vector variable, len is its lane count
+            int loop;       // in range on the fast path of this versioned loop
+        } index;
     };
-}; // maybe add location info for better error reporting
+};
 
 /* statements */
 
 // kinds of statements
 typedef enum {
-    STMT_VAR, STMT_ASSIGN, STMT_IF, STMT_WHILE, STMT_PRINT, STMT_RETURN
-} StmtKind; // later: add for loop, break, continue, block
+    STMT_VAR, STMT_ASSIGN, STMT_IF, STMT_WHILE, STMT_PRINT, STMT_RETURN,
+    STMT_FREE, STMT_EXPR, STMT_PFOR
+} StmtKind; // later: add sequential for, break, continue, block
+
+// pre-loop test under which every index into a loop's arrays is in range,
+// codegen emits the body twice: unchecked when it holds, checked otherwise
+typedef struct AST_Guard {
+    int loop;            // matches AST_Expr.index.loop
+    const char *var;     // induction variable, var >= 0 on entry
+    AST_Expr *step;      // var = var + step, NULL when a constant >= 0
+    AST_Expr *bound;     // var < bound or var <= bound, NULL when constant
+    bool inclusive;
+    int len;             // shortest array indexed by var
+} AST_Guard;
+
+// how a parallel for combines an outer int across chunks
+typedef enum { REDUCE_NONE, REDUCE_ADD, REDUCE_MUL, REDUCE_MIN, REDUCE_MAX } Reduce;
+
+// outer variable used in a parallel for body, see sema/parallel.c
+typedef struct {
+    const char *name;
+    Type type;       // element type for arrays
+    int len;         // > 0: array, shared, elements written only at the loop index
+    Reduce reduce;   // NONE: read-only copy, else a per-chunk accumulator
+} AST_Capture;
 
 // statement node
 struct AST_Stmt {
     StmtKind kind;
+    int line;
+    int branch;    // if/while: entry in AST_Program.branches, kept by inlined copies
     union {
         AST_VarDecl var;
-        struct { const char *name; AST_Expr *expr; } assign;
+        struct { const char *name; AST_Expr *expr; AST_Expr *index; } assign;  // index: EXPR_INDEX target or NULL
         struct { AST_Expr *cond; AST_Block then, else_; } if_;
-        struct { AST_Expr *cond; AST_Block body; } while_;
+        struct {
+            AST_Expr *cond; AST_Block body; struct AST_Guard *guard;
+            bool short_trip;  // bounded, loop-free body: no gc poll needed, see opt/range.c
+        } while_;
+        struct {
+            const char *var; AST_Expr *lo, *hi; AST_Block body;  // var from lo to hi - 1
+            AST_Capture *caps; int cap_count;   // filled in by sema
+            struct AST_Guard *guard;  // chunks inside [0, guard->len) skip index checks
+            int id;                   // codegen: body outlined as kl_parN
+            bool short_trip;          // like while_.short_trip
+        } pfor;
         AST_Expr *print;
         AST_Expr *ret;
+        const char *free_;  // manual var, kept for compatibility, region frees it
+        AST_Expr *expr;     // call evaluated for its effects
     };
-}; // consider location tracking for error messages
\ No newline at end of file
+};
+
+// expression visitor, see ast.c
+typedef void (*AST_ExprFn)(AST_Expr *e, void *ctx);
+void ast_visit_expr(AST_Expr *e, AST_ExprFn fn, void *ctx);
+void ast_visit_block(AST_Block b, AST_ExprFn fn, void *ctx);
@@ -1,33 +1,21 @@
 #include "cgen.h"
+#include "../lexer/lexer.h"  // operator token kinds stored in the ast
 #include "../utils/die.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 
-/* token constants we need */
-#define TOK_PLUS 1
-#define TOK_MINUS 2
-#define TOK_EQ 3
-#define TOK_NE 4
-#define TOK_LT 5
-#define TOK_LE 6
-#define TOK_GT 7
-#define TOK_GE 8
-
-/* get expr type – sema has real info, this is for printing only */
-static Type expr_type(AST_Expr *e) {
-    switch (e->kind) {
-    case EXPR_INT: return TYPE_INT;
-    case EXPR_STR: return TYPE_STRING;
-    case EXPR_IDENT: return TYPE_INT; /* assume int – use sema later */
-    case EXPR_BIN:   return TYPE_INT;
-    case EXPR_CMP:   return TYPE_INT;
-    case EXPR_CALL:  return TYPE_INT; /* assume int – not always true */
-    }
-    return TYPE_VOID;
-}
-
 static FILE *out;
+static const CgenOptions *opt;
+static AST_Program *prog;
+
+static void expr_gen(AST_Expr *e);
+
+/* user main becomes kl_main so the c main can set up the runtime first */
+static const char *fname(const char *name) {
+    return strcmp(name, "main") ? name : "kl_main";
+}
 
 /* wrapper around printf for output */
 static void emit(const char *fmt, ...) {
@@ -38,34 +26,462 @@ static void emit(const char *fmt, ...) {
 static const char *ctype(Type t) {
     switch (t) {
     case TYPE_INT: return "int";
-    case TYPE_STRING: return "char*";
+    case TYPE_STRING: return "kstr";
+    case TYPE_FLOAT: return "float";
+    case TYPE_DOUBLE: return "double";
+    case TYPE_FLOAT4: return "KiloFloat4";
+    case TYPE_INT4: return "KiloInt4";
+    case TYPE_FLOAT8: return "KiloFloat8";
+    case TYPE_TASK: return "KiloTask *";
     default: return "void"; // todo: handle other types later
     }
 }
 
+/* KiloTask.ret member holding a result of type t */
+static const char *ret_field(Type t) {
+    return t == TYPE_STRING ? "s" : t == TYPE_FLOAT ? "f" : t == TYPE_DOUBLE ? "d" : "i";
+}
+
+/* ------------------------------------------------------------------ */
+/* heap profile sites */
+
+/* site table, index 0 is the untracked site */
+static struct { const char *func; int line; } *sites;
+static int site_count, site_cap;
+
+/* expressions that may allocate: the root of each string '+' chain */
+static bool expr_allocates(AST_Expr *e) {
+    return e->kind == EXPR_BIN && e->ty == TYPE_STRING && !e->chained;
+}
+
+/* number every allocating expression so cgen can pass gc_alloc_site ids */
+static void site_add(AST_Expr *e, void *func) {
+    if (!expr_allocates(e)) return;
+    if (site_count >= site_cap) {
+        site_cap = site_cap ? site_cap*2 : 16;
+        sites = realloc(sites, site_cap * sizeof *sites);
+    }
+    sites[site_count].func = func;
+    sites[site_count].line = e->line;
+    e->site = site_count++;
+}
+
+/* s as a c string literal; kl string literals keep their source escapes,
+   but a file path is raw bytes */
+static void emit_quoted(const char *s) {
+    emit("\"");
+    for (const unsigned char *c = (const unsigned char *)s; *c; c++) {
+        if (*c == '"' || *c == '\\' || *c == '?') emit("\\%c", *c);  // ? for trigraphs
+        else if (*c < ' ' || *c >= 0x7f) emit("\\%03o", *c);
+        else emit("%c", *c);
+    }
+    emit("\"");
+}
+
+static void emit_sites(void) {
+    emit("static const GcSite kl_sites[] = {\n");
+    emit("    { \"?\", \"?\", 0 },\n");
+    for (int i=1;i<site_count;i++) {
+        emit("    { \"%s\", ", sites[i].func);
+        emit_quoted(opt->src_path);
+        emit(", %d },\n", sites[i].line);
+    }
+    emit("};\n\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* --profile-gen counters, see rt/prof.h */
+
+static void prof_decls(void) {
+    emit("static uint64_t kl_prof_calls[%d];\n", prog->func_count);
+    emit("static uint64_t kl_prof_br[%d][2];\n\n", prog->branch_count);
+}
+
+static void prof_tables(void) {
+    emit("static const char *const kl_prof_funcs[] = {\n");
+    for (int i=0;i<prog->func_count;i++) emit("    \"%s\",\n", prog->funcs[i].name);
+    emit("};\n\nstatic const KiloProfBranch kl_prof_branches[] = {\n    { \"?\", 0, 0 },\n");
+    for (int i=1;i<prog->branch_count;i++)
+        emit("    { \"%s\", %d, %d },\n", prog->branches[i].func, prog->branches[i].ordinal,
+             prog->branches[i].line);
+    emit("};\n\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* stack storage for allocations escape analysis proved frame-local */
+
+static int frame_bufs;
+
+/* one buffer per site, reused each time the site runs; results that don't
+ * fit fall back to the heap at runtime */
+static void frame_buf(AST_Expr *e, void *ctx) {
+    (void)ctx;
+    if (!expr_allocates(e) || !e->no_escape) return;
+    e->buf = ++frame_bufs;
+    emit("    char kl_buf%d[KILO_STACK_BYTES];\n", e->buf);
+}
+
+/* ------------------------------------------------------------------ */
+/* regions for manual variables */
+
+static AST_FuncDecl *cur_fn;
+static bool has_region;  /* cur_fn declared kl_rgn, every exit must release it */
+
+/* heap allocations stored into manual vars; stack buffers take precedence */
+static void region_use(AST_Expr *e, void *ctx) {
+    (void)ctx;
+    if (expr_allocates(e) && e->in_region && !e->buf) has_region = true;
+}
+
+/* return through the region release, value computed while it is still live */
+static void return_gen(AST_Expr *ret) {
+    if (!has_region) {
+        emit("    return"); if (ret) { emit(" "); expr_gen(ret); } emit(";\n");
+        return;
+    }
+    if (!ret) { emit("    region_release(&kl_rgn);\n    return;\n"); return; }
+    emit("    { %s kl_ret = ", ctype(cur_fn->ret_ty)); expr_gen(ret);
+    emit("; region_release(&kl_rgn); return kl_ret; }\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* string concatenation */
+
+/* leaves of a string '+' chain, left to right */
+static void concat_parts(AST_Expr *e, AST_Expr ***v, int *n, int *cap) {
+    if (e->kind == EXPR_BIN && e->ty == TYPE_STRING) {
+        concat_parts(e->bin.left, v, n, cap);
+        concat_parts(e->bin.right, v, n, cap);
+        return;
+    }
+    if (*n == *cap) {
+        *cap = *cap ? *cap*2 : 8;
+        *v = realloc(*v, *cap * sizeof **v);
+    }
+    (*v)[(*n)++] = e;
+}
+
+/* where the result of allocating expression e goes, see KAlloc */
+static void alloc_gen(AST_Expr *e) {
+    if (e->buf) emit("(KAlloc){ kl_buf%d, sizeof kl_buf%d, ", e->buf, e->buf);
+    else emit("(KAlloc){ NULL, 0, ");
+    emit("%d, %s }", e->site, has_region && e->in_region && !e->buf ? "&kl_rgn" : "NULL");
+}
+
+static void parts_gen(AST_Expr **v, int n) {
+    emit("%d, (kstr[]){ ", n);
+    for (int i=0;i<n;i++) { if (i) emit(", "); expr_gen(v[i]); }
+    emit(" }");
+}
+
+/* a + b + c -> one kstr_concat sized for all parts */
+static void concat_gen(AST_Expr *e) {
+    AST_Expr **v = NULL; int n = 0, cap = 0;
+    concat_parts(e, &v, &n, &cap);
+    emit("kstr_concat("); alloc_gen(e); emit(", "); parts_gen(v, n); emit(")");
+    free(v);
+}
+
+/* name = name + ... grows name's buffer in place when it owns the tail,
+ * so strings built up in a loop cost linear time */
+static bool append_gen(const char *name, AST_Expr *e) {
+    if (!expr_allocates(e)) return false;
+    AST_Expr **v = NULL; int n = 0, cap = 0;
+    concat_parts(e, &v, &n, &cap);
+    bool self = v[0]->kind == EXPR_IDENT && !strcmp(v[0]->ident, name);
+    if (self) {
+        emit("    kstr_append(&%s, ", name); alloc_gen(e); emit(", ");
+        parts_gen(v + 1, n - 1); emit(");\n");
+    }
+    free(v);
+    return self;
+}
+
+/* ------------------------------------------------------------------ */
+/* arrays */
+
+static int fast_loop;  /* versioned loop whose unchecked copy is being emitted */
+
+static void index_gen(AST_Expr *e) {
+    emit("%s[", e->index.name);
+    if (e->index.unchecked || (e->index.loop && e->index.loop == fast_loop)) {
+        expr_gen(e->index.at);
+    } else {
+        emit("kilo_idx("); expr_gen(e->index.at);
+        emit(", %d, %d)", e->index.len, e->line);
+    }
+    emit("]");
+}
+
+/* test under which every index in the guarded loop is in range, see AST_Guard */
+static void guard_gen(AST_Guard *g) {
+    emit("%s >= 0", g->var);
+    if (g->step) {
+        emit(" && "); expr_gen(g->step); emit(" >= 0 && ");
+        expr_gen(g->step); emit(" <= INT_MAX - %d", g->len);
+    }
+    if (g->bound) { emit(" && "); expr_gen(g->bound); emit(" %s %d", g->inclusive ? "<" : "<=", g->len); }
+}
+
+static void stmt_gen(AST_Stmt *s);
+
+/* if/while condition: counted under --profile-gen, hinted under --profile-use */
+static void cond_gen(AST_Stmt *s, AST_Expr *c) {
+    if (opt->profile_gen) {
+        emit("kilo_prof_br(kl_prof_br[%d], ", s->branch); expr_gen(c); emit(")");
+        return;
+    }
+    int expect = prog->branches[s->branch].expect;
+    if (expect) emit(expect > 0 ? "KILO_LIKELY(" : "KILO_UNLIKELY(");
+    expr_gen(c);
+    if (expect) emit(")");
+}
+
+/* every loop back-edge polls the gc, so a loop that never allocates can't
+ * hold up a collection on another thread; short counted loops are left to
+ * the loop around them (opt/range.c) */
+static void while_gen(AST_Stmt *s) {
+    emit("    while ("); cond_gen(s, s->while_.cond); emit(") {\n");
+    for (int i=0;i<s->while_.body.count;i++) stmt_gen(s->while_.body.stmts[i]);
+    if (!s->while_.short_trip) emit("    GC_POLL();\n");
+    emit("    }\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* parallel for: each body is outlined into kl_parN(env, lo, hi, chunk)
+ * and run in chunks by kilo_par_for (rt/pool.h). the env points at the
+ * captured variables (sema/parallel.c); read-only scalars are copied in,
+ * reductions start every chunk at their identity and leave the partial
+ * result in a per-chunk slot the caller folds in chunk order */
+
+static struct { AST_Stmt *s; AST_FuncDecl *f; } *pars;
+static int par_count, par_cap;
+
+static void par_collect(AST_Block b, AST_FuncDecl *f) {
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        if (s->kind == STMT_IF) { par_collect(s->if_.then, f); par_collect(s->if_.else_, f); }
+        if (s->kind == STMT_WHILE) par_collect(s->while_.body, f);
+        if (s->kind != STMT_PFOR) continue;
+        if (par_count == par_cap) {
+            par_cap = par_cap ? par_cap*2 : 8;
+            pars = realloc(pars, par_cap * sizeof *pars);
+        }
+        pars[par_count].s = s;
+        pars[par_count].f = f;
+        s->pfor.id = ++par_count;
+        par_collect(s->pfor.body, f);
+    }
+}
+
+static bool has_reduction(AST_Stmt *s) {
+    for (int i=0;i<s->pfor.cap_count;i++) if (s->pfor.caps[i].reduce) return true;
+    return false;
+}
+
+static void par_decl(AST_Stmt *s) {
+    int id = s->pfor.id;
+    emit("struct kl_par%d_env {", id);
+    for (int i=0;i<s->pfor.cap_count;i++)
+        emit(" %s *%s;", ctype(s->pfor.caps[i].type), s->pfor.caps[i].name);
+    if (!s->pfor.cap_count) emit(" char kl_none;");  /* c has no empty structs */
+    emit(" };\n");
+    emit("static void kl_par%d(void *kl_envp, int kl_lo, int kl_hi, int kl_chunk);\n", id);
+}
+
+/* caller side: bounds once, run the chunks, fold the reductions */
+static void pfor_gen(AST_Stmt *s) {
+    int id = s->pfor.id;
+    bool red = has_reduction(s);
+    emit("    {\n    int kl_lo%d = ", id); expr_gen(s->pfor.lo);
+    emit(", kl_hi%d = ", id); expr_gen(s->pfor.hi); emit(";\n");
+    for (int i=0;i<s->pfor.cap_count;i++)
+        if (s->pfor.caps[i].reduce)
+            emit("    int kl_part%d_%s[KILO_PAR_MAX_CHUNKS];\n", id, s->pfor.caps[i].name);
+    emit("    struct kl_par%d_env kl_env%d = { ", id, id);
+    for (int i=0;i<s->pfor.cap_count;i++) {
+        AST_Capture *c = &s->pfor.caps[i];
+        if (i) emit(", ");
+        if (c->len) emit("%s", c->name);
+        else if (c->reduce) emit("kl_part%d_%s", id, c->name);
+        else emit("&%s", c->name);
+    }
+    if (!s->pfor.cap_count) emit("0");
+    emit(" };\n    ");
+    if (red) emit("int kl_chunks%d = ", id);
+    emit("kilo_par_for(kl_lo%d, kl_hi%d, kl_par%d, &kl_env%d);\n", id, id, id, id);
+    for (int i=0;i<s->pfor.cap_count;i++) {
+        AST_Capture *c = &s->pfor.caps[i];
+        if (!c->reduce) continue;
+        emit("    for (int kl_c = 0; kl_c < kl_chunks%d; kl_c++) ", id);
+        switch (c->reduce) {
+        case REDUCE_ADD: emit("%s = %s + kl_part%d_%s[kl_c];\n", c->name, c->name, id, c->name); break;
+        case REDUCE_MUL: emit("%s = %s * kl_part%d_%s[kl_c];\n", c->name, c->name, id, c->name); break;
+        default:
+            emit("if (kl_part%d_%s[kl_c] %s %s) %s = kl_part%d_%s[kl_c];\n", id, c->name,
+                 c->reduce == REDUCE_MIN ? "<" : ">", c->name, c->name, id, c->name);
+            break;
+        }
+    }
+    emit("    }\n");
+}
+
+static void par_loop_gen(AST_Stmt *s) {
+    const char *v = s->pfor.var;
+    emit("    for (int %s = kl_lo; %s < kl_hi; %s++) {\n", v, v, v);
+    for (int i=0;i<s->pfor.body.count;i++) stmt_gen(s->pfor.body.stmts[i]);
+    if (!s->pfor.short_trip) emit("    GC_POLL();\n");
+    emit("    }\n");
+}
+
+/* the outlined body, with the unchecked copy under its guard like while */
+static void par_func_gen(AST_Stmt *s, AST_FuncDecl *f) {
+    static const char *identity[] = { "", "0", "1", "INT_MAX", "INT_MIN" };
+    int id = s->pfor.id;
+    cur_fn = f;
+    has_region = false;
+    emit("static void kl_par%d(void *kl_envp, int kl_lo, int kl_hi, int kl_chunk) {\n", id);
+    if (s->pfor.cap_count) emit("    struct kl_par%d_env *kl_env = kl_envp;\n", id);
+    else emit("    (void)kl_envp;\n");
+    if (!has_reduction(s)) emit("    (void)kl_chunk;\n");
+    for (int i=0;i<s->pfor.cap_count;i++) {
+        AST_Capture *c = &s->pfor.caps[i];
+        if (c->len) emit("    %s *%s = kl_env->%s;\n", ctype(c->type), c->name, c->name);
+        else if (c->reduce) emit("    int %s = %s;\n", c->name, identity[c->reduce]);
+        else emit("    %s %s = *kl_env->%s;\n", ctype(c->type), c->name, c->name);
+    }
+    if (s->pfor.guard) {
+        emit("    if (kl_lo >= 0 && kl_hi <= %d) {\n", s->pfor.guard->len);
+        fast_loop = s->pfor.guard->loop;
+        par_loop_gen(s);
+        fast_loop = 0;
+        emit("    } else {\n");
+        par_loop_gen(s);
+        emit("    }\n");
+    } else {
+        par_loop_gen(s);
+    }
+    for (int i=0;i<s->pfor.cap_count;i++)
+        if (s->pfor.caps[i].reduce)
+            emit("    kl_env->%s[kl_chunk] = %s;\n", s->pfor.caps[i].name, s->pfor.caps[i].name);
+    emit("}\n\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* tasks: spawn f(args) calls kl_spawn_f, which copies the arguments into a
+ * gc record after the KiloTask header and queues it; kl_run_f unpacks them
+ * on whichever thread runs the task */
+
+static bool *spawned;  /* per function: target of some spawn */
+
+static void spawn_mark(AST_Expr *e, void *ctx) {
+    (void)ctx;
+    if (e->kind != EXPR_SPAWN) return;
+    for (int i=0;i<prog->func_count;i++)
+        if (!strcmp(prog->funcs[i].name, e->call.name)) spawned[i] = true;
+}
+
+static void task_gen(AST_FuncDecl *f) {
+    const char *n = fname(f->name);
+    emit("struct kl_task_%s { KiloTask kl_t;", n);
+    for (int j=0;j<f->param_count;j++) emit(" %s %s;", ctype(f->params[j].type), f->params[j].name);
+    emit(" };\n\n");
+    emit("static void kl_run_%s(KiloTask *kl_t) {\n", n);
+    if (f->param_count) emit("    struct kl_task_%s *kl_k = (struct kl_task_%s *)kl_t;\n", n, n);
+    emit("    kl_t->ret.%s = %s(", ret_field(f->ret_ty), n);
+    for (int j=0;j<f->param_count;j++) emit("%skl_k->%s", j ? ", " : "", f->params[j].name);
+    emit(");\n}\n\n");
+    emit("static KiloTask *kl_spawn_%s(", n);
+    for (int j=0;j<f->param_count;j++)
+        emit("%s%s %s", j ? ", " : "", ctype(f->params[j].type), f->params[j].name);
+    emit(f->param_count ? ") {\n" : "void) {\n");
+    emit("    struct kl_task_%s *kl_k = kilo_task_new(sizeof *kl_k, kl_run_%s);\n", n, n);
+    for (int j=0;j<f->param_count;j++) emit("    kl_k->%s = %s;\n", f->params[j].name, f->params[j].name);
+    emit("    return kilo_task_start(&kl_k->kl_t);\n}\n\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* numbers and vectors, see rt/vec.h */
+
+/* enough digits to read back the same value, always with a '.' or exponent
+ * so a float suffix stays valid c */
+static void float_gen(AST_Expr *e) {
+    char buf[40];
+    snprintf(buf, sizeof buf, e->ty == TYPE_FLOAT ? "%.9g" : "%.17g", e->float_lit);
+    if (!strpbrk(buf, ".e")) strcat(buf, ".0");
+    emit("%s%s", buf, e->ty == TYPE_FLOAT ? "f" : "");
+}
+
+/* suffix of the rt/vec.h helpers for vector type t */
+static const char *vec_name(Type t) {
+    return t == TYPE_INT4 ? "int4" : t == TYPE_FLOAT8 ? "float8" : "float4";
+}
+
+/* T(x), T(a, b, ...), hsum/hmin/hmax(v) */
+static void builtin_gen(AST_Expr *e) {
+    AST_Expr **a = e->call.args;
+    int n = e->call.arg_count;
+    if (!type_lanes(e->ty) && type_lanes(a[0]->ty)) {  /* only folds take a vector to a scalar */
+        emit("kilo_%s_%s(", e->call.name, vec_name(a[0]->ty)); expr_gen(a[0]); emit(")");
+    } else if (!type_lanes(e->ty)) {
+        emit("((%s)(", ctype(e->ty)); expr_gen(a[0]); emit("))");
+    } else if (n == 1 && a[0]->ty == e->ty) {
+        expr_gen(a[0]);
+    } else if (n == 1 && type_lanes(a[0]->ty)) {
+        emit("__builtin_convertvector("); expr_gen(a[0]); emit(", %s)", ctype(e->ty));
+    } else if (n == 1) {  /* splat: a scalar operand is broadcast */
+        emit("((%s){0} + ", ctype(e->ty)); expr_gen(a[0]); emit(")");
+    } else {
+        emit("((%s){ ", ctype(e->ty));
+        for (int i=0;i<n;i++) { if (i) emit(", "); expr_gen(a[i]); }
+        emit(" })");
+    }
+}
+
+/* ------------------------------------------------------------------ */
+
 /* generate code for expression */
 static void expr_gen(AST_Expr *e) {
     switch (e->kind) {
     case EXPR_INT: emit("%d", e->int_lit); break;
-    case EXPR_STR: emit("\"%s\"", e->str_lit); break;
+    case EXPR_STR: emit("KSTR_LIT(\"%s\")", e->str_lit); break;
     case EXPR_IDENT: emit("%s", e->ident); break;
     case EXPR_BIN:
+        if (e->ty == TYPE_STRING) { concat_gen(e); break; }
         emit("("); expr_gen(e->bin.left);
-        emit(" %c ", e->bin.op==TOK_PLUS?'+':'-'); // todo: handle * / %
+        emit(" %c ", e->bin.op==TOK_PLUS?'+':e->bin.op==TOK_MINUS?'-':e->bin.op==TOK_STAR?'*':'/');
         expr_gen(e->bin.right); emit(")"); break;
     case EXPR_CMP: {
+        if (e->cmp.left->ty == TYPE_STRING) {
+            emit("%skstr_eq(", e->cmp.cmp == TOK_NE ? "!" : "");
+            expr_gen(e->cmp.left); emit(", "); expr_gen(e->cmp.right); emit(")");
+            break;
+        }
         expr_gen(e->cmp.left);
         const char *ops[] = { "==", "!=", "<", "<=", ">", ">=" };
-        emit(" %s ", ops[e->cmp.cmp - TOK_EQ]); // fragile – validate enum alignment
+        emit(" %s ", ops[e->cmp.cmp - TOK_EQ]); // relies on TOK_EQ..TOK_GE order
         expr_gen(e->cmp.right); break;
     }
     case EXPR_CALL:
-        emit("%s(", e->call.name);
+        emit("%s(", fname(e->call.name));
+        for (int i=0;i<e->call.arg_count;i++) {
+            if (i) emit(", ");
+            expr_gen(e->call.args[i]);
+        }
+        emit(")"); break;
+    case EXPR_INDEX: index_gen(e); break;
+    case EXPR_SPAWN:
+        emit("kl_spawn_%s(", fname(e->call.name));
         for (int i=0;i<e->call.arg_count;i++) {
             if (i) emit(", ");
             expr_gen(e->call.args[i]);
         }
         emit(")"); break;
+    case EXPR_JOIN:
+        emit("kilo_join("); expr_gen(e->join);
+        emit(", %d)->ret.%s", e->line, ret_field(e->ty)); break;
+    case EXPR_FLOAT: float_gen(e); break;
+    case EXPR_BUILTIN: builtin_gen(e); break;
     }
 }
 
@@ -73,15 +489,22 @@ static void expr_gen(AST_Expr *e) {
 static void stmt_gen(AST_Stmt *s) {
     switch (s->kind) {
     case STMT_VAR: {
-        emit("    %s %s", ctype(s->var.type), s->var.name);
+        emit("    %s %s", ctype(s->var.task ? TYPE_TASK : s->var.type), s->var.name);
+        if (s->var.len) emit("[%d] = {0}", s->var.len);
         if (s->var.init) { emit(" = "); expr_gen(s->var.init); }
         emit(";\n");
         break;
     }
     case STMT_ASSIGN:
+        if (s->assign.index) {
+            emit("    "); index_gen(s->assign.index); emit(" = ");
+            expr_gen(s->assign.expr); emit(";\n");
+            break;
+        }
+        if (append_gen(s->assign.name, s->assign.expr)) break;
         emit("    %s = ", s->assign.name); expr_gen(s->assign.expr); emit(";\n"); break;
     case STMT_IF:
-        emit("    if ("); expr_gen(s->if_.cond); emit(") {\n");
+        emit("    if ("); cond_gen(s, s->if_.cond); emit(") {\n");
         for (int i=0;i<s->if_.then.count;i++) stmt_gen(s->if_.then.stmts[i]);
         emit("    }\n");
         if (s->if_.else_.count) {
@@ -91,37 +514,149 @@ static void stmt_gen(AST_Stmt *s) {
         }
         break;
     case STMT_WHILE:
-        emit("    while ("); expr_gen(s->while_.cond); emit(") {\n");
-        for (int i=0;i<s->while_.body.count;i++) stmt_gen(s->while_.body.stmts[i]);
+        if (!s->while_.guard) { while_gen(s); break; }
+        emit("    if ("); guard_gen(s->while_.guard); emit(") {\n");
+        fast_loop = s->while_.guard->loop;
+        while_gen(s);
+        fast_loop = 0;
+        emit("    } else {\n");
+        while_gen(s);
         emit("    }\n");
         break;
+    case STMT_PFOR:
+        pfor_gen(s);
+        break;
     case STMT_PRINT:
-        emit("    printf(\"%s\\n\", ", 
-             expr_type(s->print)==TYPE_INT ? "%d" : "%s"); // todo: support more types
-        expr_gen(s->print); emit(");\n");
+        if (s->print->ty == TYPE_STRING) {
+            emit("    kstr_println("); expr_gen(s->print); emit(");\n");
+            break;
+        }
+        if (type_lanes(s->print->ty) || s->print->ty == TYPE_FLOAT || s->print->ty == TYPE_DOUBLE) {
+            emit("    kilo_println_%s(", type_lanes(s->print->ty) ? vec_name(s->print->ty) : "double");
+            expr_gen(s->print); emit(");\n");
+            break;
+        }
+        emit("    kilo_println_int("); expr_gen(s->print); emit(");\n");
+        break;
+    case STMT_EXPR:  /* an inlined call leaves just its unused result */
+        emit(s->expr->kind == EXPR_CALL ? "    " : "    (void)"); expr_gen(s->expr); emit(";\n");
         break;
     case STMT_RETURN:
-        emit("    return"); if (s->ret) { emit(" "); expr_gen(s->ret); } emit(";\n");
+        return_gen(s->ret);
+        break;
+    case STMT_FREE:
+        emit("    /* free(%s): released with the region */\n", s->free_);
         break;
     }
 }
 
+/* ------------------------------------------------------------------ */
+/* functions */
+
+static void signature_gen(AST_FuncDecl *f, const char *prefix) {
+    emit("%s %s%s(", ctype(f->ret_ty), prefix, fname(f->name));
+    for (int j=0;j<f->param_count;j++) {
+        if (j) emit(", ");
+        emit("%s %s", ctype(f->params[j].type), f->params[j].name);
+    }
+    emit(f->param_count ? ")" : "void)");
+}
+
+/* everything is static, only what main reaches is emitted (opt_prune);
+ * prototypes carry what opt/purity.c proved and opt/profile.c measured, and
+ * let calls come before definitions; a @memo function's body is
+ * kl_impl_NAME behind the cache */
+static void proto_gen(AST_FuncDecl *f) {
+    const char *attr = f->purity == PURITY_CONST ? "KILO_CONST " :
+                       f->purity == PURITY_PURE ? "KILO_PURE " : "";
+    const char *temp = f->hot ? "KILO_HOT " : f->cold ? "KILO_COLD " : "";
+    emit("static %s%s", attr, temp); signature_gen(f, ""); emit(";\n");
+    if (f->memo) { emit("static %s%s", attr, temp); signature_gen(f, "kl_impl_"); emit(";\n"); }
+}
+
+static void func_gen(AST_FuncDecl *f) {
+    emit("static ");
+    signature_gen(f, f->memo ? "kl_impl_" : "");
+    emit(" {\n");
+    if (opt->profile_gen) emit("    kl_prof_calls[%d]++;\n", (int)(f - prog->funcs));
+    if (f->recursive) emit("    GC_POLL();\n");  // recursion is a loop too
+    cur_fn = f;
+    frame_bufs = 0;
+    ast_visit_block(f->body, frame_buf, NULL);
+    has_region = false;
+    ast_visit_block(f->body, region_use, NULL);
+    if (has_region) emit("    KiloRegion kl_rgn = KILO_REGION_INIT;\n");
+    for (int j=0;j<f->body.count;j++) stmt_gen(f->body.stmts[j]);
+    if (has_region) emit("    region_release(&kl_rgn);\n");
+    if (f->ret_ty == TYPE_STRING || type_lanes(f->ret_ty)) emit("    return (%s){0};\n}\n\n", ctype(f->ret_ty));
+    else emit("    return 0;\n}\n\n");
+}
+
+/* NAME looks its arguments up in a per-thread cache before running the
+ * body; recursive calls go through NAME too, so fib(n) runs each n once */
+static void memo_gen(AST_FuncDecl *f) {
+    const char *n = fname(f->name);
+    emit("static _Thread_local KiloMemo kl_memo_%s = KILO_MEMO_INIT(%d);\n\n", n, f->param_count);
+    emit("static "); signature_gen(f, ""); emit(" {\n    int kl_key[] = { ");
+    for (int j=0;j<f->param_count;j++) emit("%s%s", j ? ", " : "", f->params[j].name);
+    emit(" };\n");
+    emit("    int *kl_hit = kilo_memo_find(&kl_memo_%s, kl_key);\n", n);
+    emit("    if (kl_hit) return *kl_hit;\n");
+    emit("    int kl_r = kl_impl_%s(", n);
+    for (int j=0;j<f->param_count;j++) emit("%s%s", j ? ", " : "", f->params[j].name);
+    emit(");\n    kilo_memo_put(&kl_memo_%s, kl_key, kl_r);\n    return kl_r;\n}\n\n", n);
+}
+
 /* main codegen entry – emits full c file */
-void cgen_emit(AST_Program *p, const char *outfile) {
+void cgen_emit(AST_Program *p, const char *outfile, const CgenOptions *o) {
+    opt = o;
+    prog = p;
     out = fopen(outfile, "w");
     if (!out) die("open %s", outfile); // todo: better error message
-    emit("#include <stdio.h>\n");
-    emit("#include \"gc.h\"\n\n"); // todo: maybe conditional include if gc used
+    site_count = 1;  // site 0 = untracked
+    if (opt->heap_profile)
+        for (int i=0;i<p->func_count;i++)
+            ast_visit_block(p->funcs[i].body, site_add, (void *)p->funcs[i].name);
+    emit("#include <limits.h>\n");
+    emit("#include \"gc.h\"\n"); // todo: maybe conditional include if gc used
+    emit("#include \"region.h\"\n");
+    emit("#include \"kstr.h\"\n");
+    emit("#include \"bounds.h\"\n");
+    emit("#include \"out.h\"\n");
+    emit("#include \"memo.h\"\n");
+    emit("#include \"prof.h\"\n");
+    emit("#include \"pool.h\"\n");
+    emit("#include \"vec.h\"\n\n");
+    emit("#ifdef __GNUC__\n#define KILO_CONST __attribute__((const))\n"
+         "#define KILO_PURE __attribute__((pure))\n"
+         "#define KILO_HOT __attribute__((hot))\n"
+         "#define KILO_COLD __attribute__((cold))\n"
+         "#define KILO_LIKELY(c) __builtin_expect(!!(c), 1)\n"
+         "#define KILO_UNLIKELY(c) __builtin_expect(!!(c), 0)\n"
+         "#else\n#define KILO_CONST\n#define KILO_PURE\n#define KILO_HOT\n#define KILO_COLD\n"
+         "#define KILO_LIKELY(c) (c)\n#define KILO_UNLIKELY(c) (c)\n#endif\n\n");
+    if (opt->profile_gen) prof_decls();
+    par_count = 0;
+    for (int i=0;i<p->func_count;i++) par_collect(p->funcs[i].body, &p->funcs[i]);
+    for (int i=0;i<par_count;i++) par_decl(pars[i].s);
+    for (int i=0;i<p->func_count;i++) proto_gen(&p->funcs[i]);
+    emit("\n");
+    spawned = calloc(p->func_count ? p->func_count : 1, sizeof *spawned);
+    for (int i=0;i<p->func_count;i++) ast_visit_block(p->funcs[i].body, spawn_mark, NULL);
+    for (int i=0;i<p->func_count;i++) if (spawned[i]) task_gen(&p->funcs[i]);
     for (int i=0;i<p->func_count;i++) {
-        AST_FuncDecl *f = &p->funcs[i];
-        emit("int %s(", f->name);
-        for (int j=0;j<f->param_count;j++) {
-            if (j) emit(", ");
-            emit("%s %s", ctype(f->params[j].type), f->params[j].name);
-        }
-        emit(") {\n");
-        for (int j=0;j<f->body.count;j++) stmt_gen(f->body.stmts[j]);
-        emit("    return 0;\n}\n\n"); // todo: handle non-int return types
+        func_gen(&p->funcs[i]);
+        if (p->funcs[i].memo) memo_gen(&p->funcs[i]);
     }
+    for (int i=0;i<par_count;i++) par_func_gen(pars[i].s, pars[i].f);
+    if (opt->heap_profile) emit_sites();
+    if (opt->profile_gen) prof_tables();
+    emit("int main(void) {\n");
+    emit("    GC_INIT();\n");  // stack base for root scanning, KILO_GC_* tuning
+    if (opt->heap_profile) emit("    gc_prof_init(kl_sites, %d);\n", site_count);
+    if (opt->profile_gen)
+        emit("    kilo_prof_init(%d, kl_prof_funcs, kl_prof_calls, %d, kl_prof_branches, kl_prof_br);\n",
+             p->func_count, p->branch_count);
+    emit("    return kl_main();\n}\n");
     fclose(out);
 }
\ No newline at end of file
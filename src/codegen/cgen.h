@@ -1,4 +1,11 @@
 #pragma once
 #include "../ast/ast.h"
 
-void cgen_emit(AST_Program *p, const char *outfile);
\ No newline at end of file
+// codegen switches, filled from kiloc flags
+typedef struct {
+    const char *src_path;   // input file, names heap profile sites
+    bool heap_profile;      // --heap-profile: tag allocations with source sites
+    bool profile_gen;       // --profile-gen: count calls and branch outcomes
+} CgenOptions;
+
+void cgen_emit(AST_Program *p, const char *outfile, const CgenOptions *opt);
@@ -4,7 +4,23 @@
 #include <stdbool.h>  // bool support, needed for c99+
 
 // enum for basic types
-// can add float, bool, custom types later
+// can add bool, custom types later
 typedef enum {
-    TYPE_INT, TYPE_STRING, TYPE_VOID
+    TYPE_INT, TYPE_STRING, TYPE_VOID,
+    TYPE_FLOAT, TYPE_DOUBLE,
+    TYPE_FLOAT4, TYPE_INT4, TYPE_FLOAT8,  // fixed-width vectors, elementwise ops
+    TYPE_ARRAY, // a whole fixed-size array, only ever indexed; the element
+                // type and length stay on its declaration
+    TYPE_TASK,  // handle of a spawned call, only ever joined; the result
+                // type stays on its declaration
 } Type;
+
+// lanes of a vector type, 0 for everything else
+static inline int type_lanes(Type t) {
+    return t == TYPE_FLOAT4 || t == TYPE_INT4 ? 4 : t == TYPE_FLOAT8 ? 8 : 0;
+}
+
+// lane type of a vector type, t itself for everything else
+static inline Type type_elem(Type t) {
+    return t == TYPE_INT4 ? TYPE_INT : type_lanes(t) ? TYPE_FLOAT : t;
+}
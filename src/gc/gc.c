@@ -1,52 +1,543 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#endif
 #include "gc.h"
+#include "../rt/out.h"
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
 
 typedef struct Obj {
     uint8_t marked;           // mark bit for gc
+    uint8_t traced;           // gc_alloc_traced: contents are scanned for pointers
+    uint32_t site;            // heap profile site, fits in the padding
     struct Obj *next;         // linked list of all objects
     size_t size;              // size of allocated data
     char data[];              // flexible array member
 } Obj;
 
-static Obj *head = NULL;      // head of allocation list
+#define GC_DEFAULT_FACTOR   2.0
+#define GC_DEFAULT_MIN_HEAP (1u << 20)  // never trigger below 1 MiB live
+#define GC_TLAB_BYTES       (64u << 10) // thread-local budget between flushes
+#define GC_MAX_SCANNERS     8
 
-void gc_init(void) { head = NULL; } // reset gc state
+enum { GC_RUNNING, GC_PARKED, GC_NATIVE };
+
+// per-thread allocation state, only its owner touches it while running
+typedef struct GcThread {
+    Obj *head;                // objects allocated by this thread
+    size_t count;
+    size_t pending;           // bytes allocated since the last flush
+    void *stack_base;
+    void *stack_top;          // valid while parked or native
+    jmp_buf regs;             // registers saved while parked or native
+    int state;
+    struct GcThread *next;
+} GcThread;
+
+atomic_int gc_stopping;  // collection in progress, polled lock-free by GC_POLL
+
+// shared collector state, guarded by lock unless noted
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t parked_cv;   // collector waits for mutators to stop
+    pthread_cond_t resume_cv;   // mutators wait for the collection to end
+    GcThread *threads;
+    int nrunning;               // registered threads not parked or native
+    Obj *orphans;               // objects left behind by exited threads
+    size_t orphan_count;
+    bool roots;                 // main stack base known, collection allowed
+    double factor;
+    size_t min_heap, max_heap;
+    void (*scanners[GC_MAX_SCANNERS])(void);  // gc_add_roots
+    int nscanners;
+    GcStats st;
+} gc = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .parked_cv = PTHREAD_COND_INITIALIZER,
+    .resume_cv = PTHREAD_COND_INITIALIZER,
+};
+
+static _Thread_local GcThread *self;
+
+// per-site counters, freed_* are bumped by sweeps with the world stopped
+typedef struct {
+    atomic_ullong alloc_bytes, alloc_objs;
+    atomic_ullong freed_bytes, freed_objs;
+} SiteCount;
+
+static struct {
+    const GcSite *sites;
+    SiteCount *count;
+    uint32_t nsites;
+    volatile sig_atomic_t dump_requested;  // set by SIGUSR2
+} prof;
+
+static void collect_locked(GcThread *me);
+
+// parse a byte count with optional k/m/g suffix, 0 on garbage
+static size_t parse_size(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    switch (*end) {
+    case 'k': case 'K': v *= 1024.0; end++; break;
+    case 'm': case 'M': v *= 1024.0 * 1024.0; end++; break;
+    case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; end++; break;
+    }
+    return v > 0 && !*end ? (size_t)v : 0;
+}
+
+// a setting the user gave that can't be used stops the program rather than
+// being swapped for the default
+static void bad_setting(const char *name, const char *val, const char *want) {
+    kilo_out_flush();
+    fprintf(stderr, "kilo: %s=%s: expected %s\n", name, val, want);
+    abort();
+}
+
+static size_t env_size(const char *name) {
+    const char *s = getenv(name);
+    size_t v = s ? parse_size(s) : 0;
+    if (s && !v) bad_setting(name, s, "a byte count like 64m");
+    return v;
+}
+
+static void stats_at_exit(void) { gc_stats_dump(stderr); }
+
+static void oom(size_t sz) {
+    kilo_out_flush();
+    fprintf(stderr, "kilo: out of memory allocating %zu bytes (live %llu, max heap %zu)\n",
+            sz, (unsigned long long)gc.st.live_bytes, gc.max_heap);
+    abort();
+}
+
+// explicit arguments win over env, env wins over defaults
+void gc_init(void *stack_base, double heap_factor, size_t max_heap) {
+    const char *s;
+    memset(&gc.st, 0, sizeof gc.st);
+    gc.roots = stack_base != NULL;
+
+    // <= 1 would collect on every allocation
+    gc.factor = heap_factor;
+    if (heap_factor && !(heap_factor > 1.0)) {
+        kilo_out_flush();
+        fprintf(stderr, "kilo: gc_init: heap factor %g must be above 1\n", heap_factor);
+        abort();
+    }
+    if (!gc.factor && (s = getenv("KILO_GC_HEAP_FACTOR"))) {
+        char *end;
+        gc.factor = strtod(s, &end);
+        if (end == s || *end || !(gc.factor > 1.0))
+            bad_setting("KILO_GC_HEAP_FACTOR", s, "a number above 1");
+    }
+    if (!gc.factor) gc.factor = GC_DEFAULT_FACTOR;
+
+    gc.max_heap = max_heap ? max_heap : env_size("KILO_GC_MAX_HEAP");
+
+    gc.min_heap = env_size("KILO_GC_MIN_HEAP");
+    if (!gc.min_heap) gc.min_heap = GC_DEFAULT_MIN_HEAP;
+    if (gc.max_heap && gc.min_heap > gc.max_heap) gc.min_heap = gc.max_heap;
+
+    gc.st.heap_limit = gc.min_heap;
+    if ((s = getenv("KILO_GC_STATS")) && *s && strcmp(s, "0")) atexit(stats_at_exit);
+
+    gc_register_thread(stack_base);
+}
+
+/* ------------------------------------------------------------------ */
+/* thread registration and safepoints */
+
+// save registers and the stack extent, then sleep until the collector is done
+// stays in this frame while parked so everything above stack_top is intact
+static void park_locked(GcThread *me) {
+    void *top = NULL;
+    setjmp(me->regs);
+    me->stack_top = &top;
+    me->state = GC_PARKED;
+    gc.nrunning--;
+    pthread_cond_signal(&gc.parked_cv);
+    while (atomic_load(&gc_stopping)) pthread_cond_wait(&gc.resume_cv, &gc.lock);
+    me->state = GC_RUNNING;
+    gc.nrunning++;
+}
+
+// take the lock from a running mutator, parking first if a collection is pending
+static void lock_mutator(GcThread *me) {
+    pthread_mutex_lock(&gc.lock);
+    while (atomic_load(&gc_stopping)) park_locked(me);
+}
+
+void gc_register_thread(void *stack_base) {
+    GcThread *t = calloc(1, sizeof *t);
+    if (!t) oom(sizeof *t);
+    t->stack_base = stack_base;
+    t->state = GC_RUNNING;
+    pthread_mutex_lock(&gc.lock);
+    while (atomic_load(&gc_stopping)) pthread_cond_wait(&gc.resume_cv, &gc.lock);
+    t->next = gc.threads;
+    gc.threads = t;
+    gc.nrunning++;
+    pthread_mutex_unlock(&gc.lock);
+    self = t;
+}
+
+// flush counters into the shared stats, caller holds the lock
+static void flush_locked(GcThread *t) {
+    gc.st.bytes_allocated += t->pending;
+    gc.st.live_bytes += t->pending;
+    t->pending = 0;
+}
+
+void gc_unregister_thread(void) {
+    GcThread *me = self;
+    if (!me) return;
+    lock_mutator(me);
+    flush_locked(me);
+    for (GcThread **pp = &gc.threads; *pp; pp = &(*pp)->next)
+        if (*pp == me) { *pp = me->next; break; }
+    while (me->head) {  // still reachable from other threads maybe, keep them
+        Obj *o = me->head;
+        me->head = o->next;
+        o->next = gc.orphans;
+        gc.orphans = o;
+    }
+    gc.orphan_count += me->count;
+    gc.nrunning--;
+    pthread_cond_signal(&gc.parked_cv);
+    pthread_mutex_unlock(&gc.lock);
+    free(me);
+    self = NULL;
+}
+
+void gc_safepoint(void) {
+    GcThread *me = self;
+    if (!me || !atomic_load_explicit(&gc_stopping, memory_order_acquire)) return;
+    pthread_mutex_lock(&gc.lock);
+    while (atomic_load(&gc_stopping)) park_locked(me);
+    pthread_mutex_unlock(&gc.lock);
+}
+
+// the saved frame must stay live until gc_leave_native, so only the caller's
+// frames above it are trusted; callers must not touch gc memory in between
+void gc_enter_native(void) {
+    GcThread *me = self;
+    void *top = NULL;
+    if (!me) return;
+    pthread_mutex_lock(&gc.lock);
+    setjmp(me->regs);
+    me->stack_top = &top;
+    me->state = GC_NATIVE;
+    gc.nrunning--;
+    pthread_cond_signal(&gc.parked_cv);
+    pthread_mutex_unlock(&gc.lock);
+}
+
+void gc_leave_native(void) {
+    GcThread *me = self;
+    if (!me) return;
+    pthread_mutex_lock(&gc.lock);
+    while (atomic_load(&gc_stopping)) pthread_cond_wait(&gc.resume_cv, &gc.lock);
+    me->state = GC_RUNNING;
+    gc.nrunning++;
+    pthread_mutex_unlock(&gc.lock);
+}
+
+/* ------------------------------------------------------------------ */
+/* allocation */
+
+// slow path: publish the thread's bytes, collect or fail against the limits
+static void flush_and_check(GcThread *me, size_t sz) {
+    lock_mutator(me);
+    flush_locked(me);
+    if (gc.roots && gc.st.live_bytes + sz > gc.st.heap_limit)
+        collect_locked(me);  // heap grew past the trigger
+    if (gc.max_heap && gc.st.live_bytes + sz > gc.max_heap)
+        oom(sz);             // still over the hard limit after collecting
+    pthread_mutex_unlock(&gc.lock);
+}
+
+// fast path touches only thread-local state; limits are enforced per flush,
+// so each thread can overshoot them by at most GC_TLAB_BYTES
+static void *alloc(size_t sz, uint32_t site, bool traced) {
+    GcThread *me = self;
+    if (!me) {
+        fprintf(stderr, "kilo: gc_alloc from a thread without gc_register_thread\n");
+        abort();
+    }
+    if (atomic_load_explicit(&gc_stopping, memory_order_relaxed)) gc_safepoint();
+    if (me->pending + sz > GC_TLAB_BYTES) flush_and_check(me, sz);
 
-void *gc_alloc(size_t sz) {
-    // todo: add null check for malloc
     Obj *o = malloc(sizeof(Obj) + sz);
+    if (!o) oom(sz);
     o->marked = 0;
+    o->traced = traced;
+    o->site = site;
     o->size = sz;
-    o->next = head;
-    head = o;
+    o->next = me->head;
+    me->head = o;
+    me->count++;
+    me->pending += sz;
+    if (site && site < prof.nsites) {
+        atomic_fetch_add_explicit(&prof.count[site].alloc_bytes, sz, memory_order_relaxed);
+        atomic_fetch_add_explicit(&prof.count[site].alloc_objs, 1, memory_order_relaxed);
+        if (prof.dump_requested) { prof.dump_requested = 0; gc_prof_dump(NULL); }
+    }
     return o->data;
 }
 
+void *gc_alloc(size_t sz) { return alloc(sz, 0, false); }
+void *gc_alloc_site(size_t sz, uint32_t site) { return alloc(sz, site, false); }
+void *gc_alloc_traced(size_t sz) { return alloc(sz, 0, true); }
+
+/* ------------------------------------------------------------------ */
+/* marking */
+
+// objects sorted by address so each candidate pointer is a binary search
+static Obj **sorted;
+static size_t nsorted;
+// traced objects marked but not yet scanned
+static Obj **gray;
+static size_t ngray, gray_cap;
+
+static int cmp_addr(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(Obj *const *)a, y = (uintptr_t)*(Obj *const *)b;
+    return (x > y) - (x < y);
+}
+
+// conservative mark: any word pointing into an object's data keeps it alive
+// most objects are leaf data (strings) whose contents are never scanned;
+// traced ones go on the gray stack and are scanned like a stack by drain
 static void mark_range(void **start, void **end) {
-    // todo: reverse args if needed depending on stack growth
-    for (void **p = start; p < end; ++p)
-        for (Obj *o = head; o; o = o->next)
-            if ((char*)*p >= (char*)o->data && (char*)*p < (char*)o->data + o->size)
-                o->marked = 1; // conservative mark if pointer is within object
+    if (start > end) { void **t = start; start = end; end = t; }  // either stack direction
+    if (!nsorted) return;
+    char *lo = sorted[0]->data;
+    char *hi = sorted[nsorted-1]->data + sorted[nsorted-1]->size;
+    for (void **p = start; p < end; ++p) {
+        char *v = *p;
+        if (v < lo || v >= hi) continue;  // cheap reject for ints and non-heap pointers
+        size_t l = 0, r = nsorted;
+        while (l < r) {                   // last object starting at or below v
+            size_t m = (l + r) / 2;
+            if ((char *)sorted[m] <= v) l = m + 1; else r = m;
+        }
+        Obj *o = l ? sorted[l-1] : NULL;
+        if (!o || v < o->data || v >= o->data + o->size || o->marked) continue;
+        o->marked = 1;
+        if (!o->traced) continue;
+        if (ngray == gray_cap) {
+            gray_cap = gray_cap ? gray_cap * 2 : 256;
+            gray = realloc(gray, gray_cap * sizeof *gray);
+            if (!gray) oom(gray_cap * sizeof *gray);
+        }
+        gray[ngray++] = o;
+    }
 }
 
-void gc_collect(void) {
-    void *dummy;
-    // todo: scan full stack, not just 1 word
-    mark_range((void**)&dummy, (void**)(&dummy + 1));
+// scan traced objects until none is left unscanned, iterative so long
+// chains can't overflow the collector's stack
+static void drain(void) {
+    while (ngray) {
+        Obj *o = gray[--ngray];
+        mark_range((void **)o->data, (void **)(o->data + o->size / sizeof(void *) * sizeof(void *)));
+    }
+}
+
+void gc_mark_roots(void *const *start, void *const *end) {
+    mark_range((void **)start, (void **)end);
+}
+
+void gc_add_roots(void (*scan)(void)) {
+    pthread_mutex_lock(&gc.lock);
+    if (gc.nscanners == GC_MAX_SCANNERS) {
+        fprintf(stderr, "kilo: too many gc root scanners\n");
+        abort();
+    }
+    gc.scanners[gc.nscanners++] = scan;
+    pthread_mutex_unlock(&gc.lock);
+}
+
+// separate frame so registers spilled by setjmp in the caller are on the scanned stack
+static void mark_own_stack(void) {
+    void *top = NULL;
+    mark_range((void **)&top, (void **)self->stack_base);
+}
 
-    Obj **prev = &head;
+static void mark_threads(GcThread *me) {
+    for (GcThread *t = gc.threads; t; t = t->next) {
+        if (!t->stack_base) continue;
+        if (t == me) {
+            jmp_buf regs;
+            setjmp(regs);                       // spill callee-saved registers
+            void (*volatile scan)(void) = mark_own_stack;
+            scan();                             // volatile call keeps it out of line
+        } else {
+            mark_range((void **)&t->regs, (void **)(&t->regs + 1));
+            mark_range((void **)t->stack_top, (void **)t->stack_base);
+        }
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void record_pause(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int b = 0;
+    while (us && b < GC_PAUSE_BUCKETS - 1) { us >>= 1; ++b; }
+    gc.st.pause_hist[b]++;
+    gc.st.pause_total_ns += ns;
+    if (ns > gc.st.pause_max_ns) gc.st.pause_max_ns = ns;
+}
+
+// free unmarked objects of one list, returns survivors
+static size_t sweep(Obj **head) {
+    size_t kept = 0;
+    Obj **prev = head;
     while (*prev) {
         Obj *cur = *prev;
         if (!cur->marked) {
             *prev = cur->next;
+            gc.st.bytes_freed += cur->size;
+            gc.st.live_bytes -= cur->size;
+            if (cur->site && cur->site < prof.nsites) {
+                atomic_fetch_add_explicit(&prof.count[cur->site].freed_bytes, cur->size, memory_order_relaxed);
+                atomic_fetch_add_explicit(&prof.count[cur->site].freed_objs, 1, memory_order_relaxed);
+            }
             free(cur); // free unreachable
         } else {
             cur->marked = 0; // unmark for next round
             prev = &cur->next;
+            kept++;
         }
     }
-    // todo: add stats/logging for freed objects
-    // todo: protect against double free or memory corruption
-}
\ No newline at end of file
+    return kept;
+}
+
+// stop the world, mark from every thread's stack, sweep every list
+// caller holds the lock and is a running registered thread
+static void collect_locked(GcThread *me) {
+    if (!gc.roots) return;  // no roots known, freeing anything would be unsafe
+    uint64_t t0 = now_ns();
+
+    atomic_store(&gc_stopping, 1);
+    while (gc.nrunning > 1) pthread_cond_wait(&gc.parked_cv, &gc.lock);
+
+    size_t total = gc.orphan_count;
+    for (GcThread *t = gc.threads; t; t = t->next) {
+        flush_locked(t);  // owners are stopped, their counters are ours now
+        total += t->count;
+    }
+    sorted = malloc((total ? total : 1) * sizeof *sorted);
+    if (!sorted) oom(total * sizeof *sorted);
+    nsorted = 0;
+    for (Obj *o = gc.orphans; o; o = o->next) sorted[nsorted++] = o;
+    for (GcThread *t = gc.threads; t; t = t->next)
+        for (Obj *o = t->head; o; o = o->next) sorted[nsorted++] = o;
+    qsort(sorted, nsorted, sizeof *sorted, cmp_addr);
+
+    mark_threads(me);
+    for (int i = 0; i < gc.nscanners; i++) gc.scanners[i]();
+    drain();
+    free(sorted);
+    sorted = NULL;
+
+    gc.orphan_count = sweep(&gc.orphans);
+    for (GcThread *t = gc.threads; t; t = t->next) t->count = sweep(&t->head);
+
+    // next trigger grows with the surviving heap
+    double next = (double)gc.st.live_bytes * gc.factor;
+    gc.st.heap_limit = next > gc.min_heap ? (uint64_t)next : gc.min_heap;
+    if (gc.max_heap && gc.st.heap_limit > gc.max_heap) gc.st.heap_limit = gc.max_heap;
+
+    gc.st.collections++;
+    record_pause(now_ns() - t0);
+
+    atomic_store(&gc_stopping, 0);
+    pthread_cond_broadcast(&gc.resume_cv);
+}
+
+void gc_collect(void) {
+    GcThread *me = self;
+    if (!me) return;
+    lock_mutator(me);
+    collect_locked(me);
+    pthread_mutex_unlock(&gc.lock);
+}
+
+/* ------------------------------------------------------------------ */
+/* heap profile */
+
+static void prof_at_exit(void) { gc_prof_dump(NULL); }
+static void prof_on_signal(int sig) { (void)sig; prof.dump_requested = 1; }
+
+void gc_prof_init(const GcSite *sites, uint32_t count) {
+    prof.count = calloc(count ? count : 1, sizeof *prof.count);
+    if (!prof.count) oom(count * sizeof *prof.count);
+    prof.sites = sites;
+    prof.nsites = count;
+    atexit(prof_at_exit);
+    struct sigaction sa = { .sa_handler = prof_on_signal };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR2, &sa, NULL);  // dumped from the next profiled allocation
+}
+
+// one folded line per metric and site: "metric;func;file:line value"
+// live = allocated and not yet swept, so it includes garbage since the last gc
+void gc_prof_dump(const char *path) {
+    if (!prof.nsites) return;
+    if (!path) path = getenv("KILO_HEAP_PROFILE");
+    if (!path || !*path) path = "kilo-heap.folded";
+    FILE *f = fopen(path, "w");
+    if (!f) { fprintf(stderr, "kilo: cannot write heap profile %s\n", path); return; }
+    for (uint32_t i = 1; i < prof.nsites; ++i) {
+        const GcSite *s = &prof.sites[i];
+        SiteCount *c = &prof.count[i];
+        unsigned long long ab = atomic_load(&c->alloc_bytes), ao = atomic_load(&c->alloc_objs);
+        unsigned long long fb = atomic_load(&c->freed_bytes), fo = atomic_load(&c->freed_objs);
+        if (!ao) continue;
+        const struct { const char *name; unsigned long long v; } m[] = {
+            { "alloc_bytes", ab }, { "alloc_objects", ao },
+            { "live_bytes", ab - fb }, { "live_objects", ao - fo },
+            { "freed_bytes", fb }, { "freed_objects", fo },
+        };
+        for (size_t k = 0; k < sizeof m / sizeof m[0]; ++k)
+            if (m[k].v) fprintf(f, "%s;%s;%s:%d %llu\n", m[k].name, s->func, s->file, s->line, m[k].v);
+    }
+    fclose(f);
+}
+
+/* ------------------------------------------------------------------ */
+/* stats */
+
+GcStats gc_stats(void) {
+    pthread_mutex_lock(&gc.lock);
+    if (self && !atomic_load(&gc_stopping)) flush_locked(self);
+    GcStats s = gc.st;
+    pthread_mutex_unlock(&gc.lock);
+    return s;
+}
+
+void gc_stats_dump(FILE *f) {
+    GcStats s = gc_stats();
+    fprintf(f, "gc: %llu collections, %llu bytes allocated, %llu freed, %llu live, next at %llu\n",
+            (unsigned long long)s.collections, (unsigned long long)s.bytes_allocated,
+            (unsigned long long)s.bytes_freed, (unsigned long long)s.live_bytes,
+            (unsigned long long)s.heap_limit);
+    if (!s.collections) return;
+    fprintf(f, "gc: pause total %.3f ms, max %.3f ms, mean %.3f ms\n",
+            s.pause_total_ns / 1e6, s.pause_max_ns / 1e6,
+            s.pause_total_ns / 1e6 / (double)s.collections);
+    for (int b = 0; b < GC_PAUSE_BUCKETS; ++b)
+        if (s.pause_hist[b])
+            fprintf(f, "gc:  %s %6llu us: %llu\n", b < GC_PAUSE_BUCKETS - 1 ? " <" : ">=",
+                    b < GC_PAUSE_BUCKETS - 1 ? 1ull << b : 1ull << (b - 1),
+                    (unsigned long long)s.pause_hist[b]);
+}
@@ -1,6 +1,76 @@
 #pragma once
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
-void  gc_init(void);
+// pause histogram: bucket 0 counts pauses under 1us, bucket i under 2^i us,
+// the last one everything from 2^(GC_PAUSE_BUCKETS-2) us up
+#define GC_PAUSE_BUCKETS 16
+
+// counters since gc_init, returned by value from gc_stats
+// other threads' allocations show up once they flush (every GC_TLAB_BYTES)
+typedef struct {
+    uint64_t collections;
+    uint64_t bytes_allocated;   // total payload bytes handed out
+    uint64_t bytes_freed;       // total payload bytes reclaimed by sweeps
+    uint64_t live_bytes;        // allocated minus freed
+    uint64_t heap_limit;        // live size that triggers the next collection
+    uint64_t pause_total_ns;
+    uint64_t pause_max_ns;
+    uint64_t pause_hist[GC_PAUSE_BUCKETS];
+} GcStats;
+
+// stack_base: address in the outermost frame, roots are scanned from there to
+//             the current frame; NULL disables automatic collection
+// heap_factor: next trigger is live_bytes * heap_factor, above 1; 0 = KILO_GC_HEAP_FACTOR or 2.0
+// max_heap:    hard limit on live bytes, 0 = KILO_GC_MAX_HEAP or unlimited
+// registers the calling thread, call once before any other thread allocates
+void  gc_init(void *stack_base, double heap_factor, size_t max_heap);
 void *gc_alloc(size_t);
-void  gc_collect(void);
\ No newline at end of file
+void  gc_collect(void);
+
+// gc_alloc objects are leaf data, their contents are never scanned; a traced
+// object is scanned conservatively like a stack, so gc pointers stored in it
+// keep their targets alive
+void *gc_alloc_traced(size_t);
+// roots outside thread stacks: each collection calls scan with the world
+// stopped, which reports memory holding gc pointers through gc_mark_roots
+void  gc_add_roots(void (*scan)(void));
+void  gc_mark_roots(void *const *start, void *const *end);
+GcStats gc_stats(void);
+void  gc_stats_dump(FILE *f);  // also run at exit when KILO_GC_STATS is set
+
+// threads: every thread that allocates must be registered, collection stops
+// the world by parking each registered thread at its next safepoint
+void  gc_register_thread(void *stack_base);
+void  gc_unregister_thread(void);   // hands the thread's objects to the shared heap
+void  gc_safepoint(void);           // poll in long loops that never allocate
+void  gc_enter_native(void);        // about to block; the gc may run without us
+void  gc_leave_native(void);        // waits out a collection in progress
+
+// inline gc_safepoint for loop back-edges: one relaxed load unless a
+// collection is waiting for this thread
+extern atomic_int gc_stopping;
+#define GC_POLL() \
+    (atomic_load_explicit(&gc_stopping, memory_order_relaxed) ? gc_safepoint() : (void)0)
+
+// heap profiler: kiloc --heap-profile tags each allocating expression with a
+// site id and passes its table to gc_prof_init; per-site counters are dumped
+// as flamegraph-folded lines at exit or on SIGUSR2 to $KILO_HEAP_PROFILE
+// (default kilo-heap.folded); site 0 is untracked and costs nothing
+typedef struct { const char *func, *file; int line; } GcSite;
+
+void  gc_prof_init(const GcSite *sites, uint32_t count);
+void *gc_alloc_site(size_t sz, uint32_t site);
+void  gc_prof_dump(const char *path);
+
+// per-site stack buffer kiloc gives allocations that never leave their frame
+#ifndef KILO_STACK_BYTES
+#define KILO_STACK_BYTES 256
+#endif
+
+// call first thing in the c main so every program frame lies below the base
+#define GC_INIT() do { void *gc_base_ = NULL; gc_init(&gc_base_, 0, 0); } while (0)
+// same for the entry function of a new thread
+#define GC_REGISTER_THREAD() do { void *gc_base_ = NULL; gc_register_thread(&gc_base_); } while (0)
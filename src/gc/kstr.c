@@ -0,0 +1,101 @@
+#include "kstr.h"
+#include "gc.h"
+#include "../rt/out.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#define KSTR_MIN_CAP 32  // first appendable buffer
+
+static void too_long(void) {
+    kilo_out_flush();
+    fprintf(stderr, "kilo: string longer than 4 GiB\n");
+    abort();
+}
+
+static size_t total_len(size_t base, int n, const kstr *parts) {
+    for (int i = 0; i < n; ++i) base += parts[i].len;
+    if (base > UINT32_MAX) too_long();
+    return base;
+}
+
+static char *copy_parts(char *d, int n, const kstr *parts) {
+    for (int i = 0; i < n; ++i) {
+        memcpy(d, kstr_ptr(&parts[i]), parts[i].len);
+        d += parts[i].len;
+    }
+    return d;
+}
+
+static void set_ptr(kstr *s, const char *p, uint32_t kind) {
+    memcpy(s->raw, &p, sizeof p);
+    memcpy(s->raw + sizeof p, &kind, sizeof kind);
+}
+
+static KBuf *buf_new(KAlloc a, size_t cap, size_t used) {
+    if (cap > UINT32_MAX) cap = UINT32_MAX;
+    size_t sz = sizeof(KBuf) + cap;
+    KBuf *b = a.rgn ? region_alloc(a.rgn, sz) : gc_alloc_site(sz, a.site);
+    b->cap = (uint32_t)cap;
+    atomic_init(&b->used, (uint32_t)used);
+    return b;
+}
+
+kstr kstr_concat(KAlloc a, int n, const kstr *parts) {
+    kstr r = {0};
+    size_t total = total_len(0, n, parts);
+    r.len = (uint32_t)total;
+    if (total <= KSTR_SSO) {
+        copy_parts(r.raw, n, parts);
+        return r;
+    }
+    char *d;
+    if (a.stack && total <= a.stack_sz) {
+        d = a.stack;
+        set_ptr(&r, d, KSTR_FOREIGN);
+    } else {
+        d = buf_new(a, total, total)->bytes;  // exact fit, appends will copy
+        set_ptr(&r, d, KSTR_BUF);
+    }
+    copy_parts(d, n, parts);
+    return r;
+}
+
+void kstr_append(kstr *dst, KAlloc a, int n, const kstr *parts) {
+    uint32_t len = dst->len;
+    size_t total = total_len(len, n, parts);
+    if (total == len) return;
+
+    if (len > KSTR_SSO && kstr_kind(dst) == KSTR_BUF) {
+        KBuf *b = (KBuf *)(kstr_ptr(dst) - offsetof(KBuf, bytes));
+        uint32_t expect = len;
+        if (total <= b->cap &&
+            atomic_compare_exchange_strong(&b->used, &expect, (uint32_t)total)) {
+            copy_parts(b->bytes + len, n, parts);  // tail is ours now
+            dst->len = (uint32_t)total;
+            return;
+        }
+    }
+
+    kstr r = {0};
+    r.len = (uint32_t)total;
+    if (total <= KSTR_SSO) {
+        memcpy(r.raw, kstr_ptr(dst), len);
+        copy_parts(r.raw + len, n, parts);
+    } else {
+        size_t cap = total * 2 > KSTR_MIN_CAP ? total * 2 : KSTR_MIN_CAP;
+        KBuf *b = buf_new(a, cap, total);
+        memcpy(b->bytes, kstr_ptr(dst), len);
+        copy_parts(b->bytes + len, n, parts);
+        set_ptr(&r, b->bytes, KSTR_BUF);
+    }
+    *dst = r;
+}
+
+bool kstr_eq(kstr a, kstr b) {
+    return a.len == b.len && !memcmp(kstr_ptr(&a), kstr_ptr(&b), a.len);
+}
+
+void kstr_println(kstr s) {
+    kilo_println_bytes(kstr_ptr(&s), s.len);
+}
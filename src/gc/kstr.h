@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "region.h"
+
+#define KSTR_SSO 11  // longest string kept inline
+
+// immutable string value, 16 bytes, passed and returned by value
+// len <= KSTR_SSO: bytes live in raw, NUL terminated, nothing allocated
+// otherwise raw holds the byte pointer followed by a kind tag
+typedef struct {
+    _Alignas(8) char raw[KSTR_SSO + 1];  // aligned so the gc sees the pointer
+    uint32_t len;
+} kstr;
+
+enum {
+    KSTR_FOREIGN,  // literal, stack buffer or exact copy, never written again
+    KSTR_BUF,      // bytes follow a KBuf header and may be appended in place
+};
+
+// appendable buffer: views share it, each sees only its own len bytes;
+// whoever extends from used == len owns the tail and bumps used
+typedef struct {
+    uint32_t cap;
+    _Atomic uint32_t used;
+    char bytes[];
+} KBuf;
+
+// where a new string may go, cheapest first
+typedef struct {
+    char *stack;         // frame buffer proven frame-local, or NULL
+    uint32_t stack_sz;
+    uint32_t site;       // heap profile site, 0 = untracked
+    KiloRegion *rgn;     // region of a manual var, NULL = gc heap
+} KAlloc;
+
+static inline uint32_t kstr_kind(const kstr *s) {
+    uint32_t k;
+    memcpy(&k, s->raw + sizeof(char *), sizeof k);
+    return k;
+}
+
+static inline const char *kstr_ptr(const kstr *s) {
+    if (s->len <= KSTR_SSO) return s->raw;
+    const char *p;
+    memcpy(&p, s->raw, sizeof p);
+    return p;
+}
+
+static inline kstr kstr_lit(const char *p, uint32_t len) {
+    kstr s = {0};
+    s.len = len;
+    if (len <= KSTR_SSO) { memcpy(s.raw, p, len); return s; }
+    memcpy(s.raw, &p, sizeof p);  // kind stays KSTR_FOREIGN
+    return s;
+}
+
+#define KSTR_LIT(s) kstr_lit(s, sizeof(s) - 1)
+
+// a + b + ... in one sized allocation
+kstr kstr_concat(KAlloc a, int n, const kstr *parts);
+// *dst = *dst + parts..., amortised O(extra) when dst owns its buffer's tail
+void kstr_append(kstr *dst, KAlloc a, int n, const kstr *parts);
+bool kstr_eq(kstr a, kstr b);
+void kstr_println(kstr s);
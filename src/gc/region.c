@@ -0,0 +1,56 @@
+#include "region.h"
+#include "../rt/out.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define REGION_CHUNK (4u << 10)  // standard chunk, larger requests get their own
+
+// released standard chunks, reused before calling malloc again
+static _Thread_local KiloChunk *spare;
+
+static KiloChunk *chunk_new(size_t cap) {
+    KiloChunk *c = malloc(sizeof *c + cap);
+    if (!c) {
+        kilo_out_flush();
+        fprintf(stderr, "kilo: out of memory allocating %zu region bytes\n", cap);
+        abort();
+    }
+    c->cap = cap;
+    c->used = 0;
+    return c;
+}
+
+void *region_alloc(KiloRegion *r, size_t sz) {
+    sz = (sz + 15) & ~(size_t)15;  // keep every allocation 16-aligned
+    if (sz > REGION_CHUNK / 2) {   // would waste most of a chunk
+        KiloChunk *c = chunk_new(sz);
+        c->next = r->big;
+        r->big = c;
+        return c->data;
+    }
+    KiloChunk *c = r->head;
+    if (!c || c->cap - c->used < sz) {
+        if (spare) { c = spare; spare = c->next; c->used = 0; }
+        else c = chunk_new(REGION_CHUNK);
+        c->next = r->head;
+        r->head = c;
+        if (!r->tail) r->tail = c;
+    }
+    void *p = c->data + c->used;
+    c->used += sz;
+    return p;
+}
+
+// standard chunks are spliced onto the spare list in one step
+void region_release(KiloRegion *r) {
+    while (r->big) {
+        KiloChunk *c = r->big;
+        r->big = c->next;
+        free(c);
+    }
+    if (r->head) {
+        r->tail->next = spare;
+        spare = r->head;
+    }
+    r->head = r->tail = NULL;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <stddef.h>
+
+// bump arena behind `manual` variables: allocation is a pointer bump and the
+// whole region goes away in one region_release when its function returns
+typedef struct KiloChunk {
+    struct KiloChunk *next;
+    size_t cap, used;
+    _Alignas(16) char data[];
+} KiloChunk;
+
+typedef struct {
+    KiloChunk *head;   // newest standard chunk, allocation happens here
+    KiloChunk *tail;   // oldest standard chunk, lets release splice in O(1)
+    KiloChunk *big;    // oversized allocations, one chunk each
+} KiloRegion;
+
+#define KILO_REGION_INIT { NULL, NULL, NULL }
+
+void *region_alloc(KiloRegion *r, size_t sz);
+void  region_release(KiloRegion *r);  // chunks go to a per-thread free list
@@ -24,7 +24,18 @@ static const struct {
     { "return", TOK_RETURN },
     { "int",    TOK_INT },
     { "string", TOK_STRING },
+    { "float",  TOK_FLOAT },
+    { "double", TOK_DOUBLE },
+    { "float4", TOK_FLOAT4 },
+    { "int4",   TOK_INT4 },
+    { "float8", TOK_FLOAT8 },
     { "manual", TOK_MANUAL },
+    { "free",   TOK_FREE },
+    { "parallel", TOK_PARALLEL },
+    { "for",    TOK_FOR },
+    { "task",   TOK_TASK },
+    { "spawn",  TOK_SPAWN },
+    { "join",   TOK_JOIN },
 };
 
 // allocate and initalise lexer
@@ -74,11 +85,27 @@ Token lexer_next(Lexer *l) {
             ++l->cur;
             return make_token(l, TOK_SLASH, l->start, l->cur);
 
-        // prase integer literals
+        // parse integer and float literals: 12, 1.5, 2e-3, 1.5e10
         case '0': case '1': case '2': case '3': case '4':
-        case '5': case '6': case '7': case '8': case '9':
+        case '5': case '6': case '7': case '8': case '9': {
+            TokenKind k = TOK_INT_LIT;
             while (isdigit((unsigned char)*l->cur)) ++l->cur;
-            return make_token(l, TOK_INT_LIT, l->start, l->cur);
+            if (l->cur[0] == '.' && isdigit((unsigned char)l->cur[1])) {
+                k = TOK_FLOAT_LIT;
+                ++l->cur;
+                while (isdigit((unsigned char)*l->cur)) ++l->cur;
+            }
+            if (*l->cur == 'e' || *l->cur == 'E') {
+                const char *e = l->cur + 1;
+                if (*e == '+' || *e == '-') ++e;
+                if (isdigit((unsigned char)*e)) {
+                    k = TOK_FLOAT_LIT;
+                    l->cur = e;
+                    while (isdigit((unsigned char)*l->cur)) ++l->cur;
+                }
+            }
+            return make_token(l, k, l->start, l->cur);
+        }
 
         // parse string literals
         case '"': {
@@ -138,6 +165,9 @@ Token lexer_next(Lexer *l) {
         case ')': ++l->cur; return make_token(l, TOK_RPAREN, l->start, l->cur);
         case '{': ++l->cur; return make_token(l, TOK_LBRACE, l->start, l->cur);
         case '}': ++l->cur; return make_token(l, TOK_RBRACE, l->start, l->cur);
+        case '[': ++l->cur; return make_token(l, TOK_LBRACKET, l->start, l->cur);
+        case ']': ++l->cur; return make_token(l, TOK_RBRACKET, l->start, l->cur);
+        case '@': ++l->cur; return make_token(l, TOK_AT, l->start, l->cur);
 
         default:
             die("line %d: unexpected character '%c'", l->line, *l->cur);
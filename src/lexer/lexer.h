@@ -7,12 +7,15 @@
 typedef enum {
     TOK_EOF, TOK_FUNC, TOK_IF, TOK_ELSE, TOK_WHILE,
     TOK_PRINT, TOK_RETURN,
-    TOK_INT, TOK_STRING, TOK_MANUAL,
-    TOK_IDENT, TOK_INT_LIT, TOK_STR_LIT,
+    TOK_INT, TOK_STRING, TOK_MANUAL, TOK_FREE,
+    TOK_FLOAT, TOK_DOUBLE, TOK_FLOAT4, TOK_INT4, TOK_FLOAT8,
+    TOK_PARALLEL, TOK_FOR, TOK_TASK, TOK_SPAWN, TOK_JOIN,
+    TOK_IDENT, TOK_INT_LIT, TOK_FLOAT_LIT, TOK_STR_LIT,
     TOK_PLUS, TOK_MINUS, TOK_STAR, TOK_SLASH,
     TOK_EQ, TOK_NE, TOK_LT, TOK_LE, TOK_GT, TOK_GE,
     TOK_ASSIGN, TOK_SEMI, TOK_COMMA,
     TOK_LPAREN, TOK_RPAREN, TOK_LBRACE, TOK_RBRACE,
+    TOK_LBRACKET, TOK_RBRACKET, TOK_AT,
     TOK_ARROW,
 } TokenKind;
 
@@ -1,6 +1,7 @@
 #include "lexer/lexer.h"     // lexer module, consider lazy lexing for large files
 #include "parser/parser.h"   // parser module, might modularize further for expressions/statements
 #include "sema/sema.h"       // semantic analysis, add type inference checks
+#include "opt/opt.h"         // ast-level optimisation passes
 #include "codegen/cgen.h"    // code generation, consider multiple backends
 #include "utils/die.h"       // error handling, could support error codes
 #include <stdio.h>
@@ -17,15 +18,57 @@ static char *read_file(const char *path) {
     fclose(f); return buf;
 }
 
+#define USAGE "usage: kiloc <in.kl> [-o out.c] [-O0..3] [--inline-threshold=N] [--heap-profile] [--memo]\n" \
+              "       [--profile-gen | --profile-use=FILE]"
+
+// inliner size threshold per -O level, see opt/inline.c
+static const int inline_thresholds[] = { 0, 12, 40, 120 };
+
 int main(int argc, char **argv) {
-    if (argc < 2) die("usage: kiloc <in.kl> [-o out.c]");  // basic arg check, could add --help
-    const char *out = "out.c";                              // default output file
-    if (argc >= 4 && !strcmp(argv[2], "-o")) out = argv[3]; // support for -o, extend to other flags
+    const char *in = NULL, *out = "out.c";  // default output file
+    CgenOptions copt = {0};
+    bool auto_memo = false;
+    int level = 1, threshold = -1;  // -1 = from level
+    const char *profile = NULL;     // --profile-use
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-o")) {
+            if (++i == argc) die(USAGE);
+            out = argv[i];
+        } else if (!strcmp(argv[i], "--heap-profile")) {
+            copt.heap_profile = true;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'O' && argv[i][2] >= '0' &&
+                   argv[i][2] <= '3' && !argv[i][3]) {
+            level = argv[i][2] - '0';
+        } else if (!strncmp(argv[i], "--inline-threshold=", 19)) {
+            threshold = atoi(argv[i] + 19);
+        } else if (!strcmp(argv[i], "--profile-gen")) {
+            copt.profile_gen = true;
+        } else if (!strncmp(argv[i], "--profile-use=", 14)) {
+            profile = argv[i] + 14;
+        } else if (!strcmp(argv[i], "--memo")) {
+            auto_memo = true;   // memoize every eligible recursive function
+        } else if (argv[i][0] == '-' || in) {
+            die(USAGE);
+        } else {
+            in = argv[i];
+        }
+    }
+    if (!in || (copt.profile_gen && profile)) die(USAGE);
+    if (copt.profile_gen) threshold = 0;  // call counters must see every call
+    copt.src_path = in;
 
-    char *src = read_file(argv[1]);     // load source file
+    char *src = read_file(in);          // load source file
     Lexer *L = lexer_new(src);          // init lexer, could cache tokens
     AST_Program *prog = parse(L);       // parse to ast, might log errors
+    opt_prune(prog);                    // unused library functions skip sema and codegen
+    profile_number(prog);               // stable branch names for --profile-gen/-use
     sema_check(prog);                   // run semantic analysis, should return status
-    cgen_emit(prog, out);              // emit c code, could support ir dump
+    if (profile) profile_load(prog, profile);
+    inline_calls(prog, threshold >= 0 ? threshold : inline_thresholds[level]);
+    opt_prune(prog);                    // callees inlined at every call site
+    range_analyze(prog);                // drop or hoist provable bounds checks
+    purity_analyze(prog, auto_memo);    // const/pure attributes, memoization
+    if (profile) profile_order(prog);
+    cgen_emit(prog, out, &copt);        // emit c code, could support ir dump
     return 0;                           // add proper exit codes on failure
 }
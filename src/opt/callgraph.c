@@ -0,0 +1,83 @@
+#include "opt.h"
+#include <stdlib.h>
+#include <string.h>
+
+// call graph queries shared by the optimisation passes; the program is small
+// enough that walking bodies on demand beats building an edge list
+
+AST_FuncDecl *opt_func(AST_Program *p, const char *name) {
+    for (int i=0;i<p->func_count;i++)
+        if (!strcmp(p->funcs[i].name, name)) return &p->funcs[i];
+    return NULL;
+}
+
+typedef struct {
+    AST_Program *prog;
+    const char *target;
+    bool *seen;
+    bool found;
+} Reach;
+
+static void reach_block(Reach *r, AST_Block b);
+
+static void reach_call(AST_Expr *e, void *ctx) {
+    Reach *r = ctx;
+    if ((e->kind != EXPR_CALL && e->kind != EXPR_SPAWN) || r->found) return;
+    if (!strcmp(e->call.name, r->target)) { r->found = true; return; }
+    AST_FuncDecl *f = opt_func(r->prog, e->call.name);
+    if (!f || r->seen[f - r->prog->funcs]) return;
+    r->seen[f - r->prog->funcs] = true;
+    reach_block(r, f->body);
+}
+
+static void reach_block(Reach *r, AST_Block b) {
+    ast_visit_block(b, reach_call, r);
+}
+
+bool opt_recursive(AST_Program *p, AST_FuncDecl *f) {
+    Reach r = { p, f->name, calloc(p->func_count, sizeof(bool)), false };
+    reach_block(&r, f->body);
+    free(r.seen);
+    return r.found;
+}
+
+/* ------------------------------------------------------------------ */
+/* dead function elimination */
+
+typedef struct {
+    AST_Program *prog;
+    int *order, n;     // reachable function indices, discovery order
+    bool *seen;
+} Walk;
+
+static void walk_func(Walk *w, int i);
+
+static void walk_call(AST_Expr *e, void *ctx) {
+    Walk *w = ctx;
+    if (e->kind != EXPR_CALL && e->kind != EXPR_SPAWN) return;
+    AST_FuncDecl *f = opt_func(w->prog, e->call.name);
+    if (f) walk_func(w, (int)(f - w->prog->funcs));  // unknown names are sema's to report
+}
+
+static void walk_func(Walk *w, int i) {
+    if (w->seen[i]) return;
+    w->seen[i] = true;
+    w->order[w->n++] = i;
+    ast_visit_block(w->prog->funcs[i].body, walk_call, w);
+}
+
+// keep only functions main can reach, main first then callees depth first;
+// without a main everything stays for sema to complain about
+void opt_prune(AST_Program *p) {
+    AST_FuncDecl *main_fn = opt_func(p, "main");
+    if (!main_fn) return;
+    Walk w = { p, malloc(p->func_count * sizeof(int)), 0, calloc(p->func_count, sizeof(bool)) };
+    walk_func(&w, (int)(main_fn - p->funcs));
+    AST_FuncDecl *kept = malloc(w.n * sizeof *kept);
+    for (int i=0;i<w.n;i++) kept[i] = p->funcs[w.order[i]];
+    free(p->funcs);
+    p->funcs = kept;
+    p->func_count = p->cap = w.n;
+    free(w.order);
+    free(w.seen);
+}
@@ -0,0 +1,460 @@
+#include "opt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ast inliner: a call to a small int function is replaced by a copy of its
+// body placed before the calling statement, the call itself by the result:
+//     x = add(a, 1) * 2;   ->   int kl_i1_x = a; int kl_i1_y = 1; int kl_i1 = 0;
+//                               kl_i1 = kl_i1_x + kl_i1_y;  x = kl_i1 * 2;
+// statements always evaluate all of their calls (there is no && or ?:), and
+// they are expanded in source order, arguments first; a call that stays a
+// call but comes before an inlined one is hoisted into a temporary ahead of
+// it, so what the callees print keeps its order. a while condition is
+// re-evaluated every iteration, so its copy is also appended to the body,
+// which has no break or continue to skip it.
+//
+// callee locals and params are renamed kl_iN_name and the result is kl_iN,
+// N unique per expansion. returns must be in tail position once
+// if (c) { ...; return a; } rest   is read as   if (c) { ... } else { rest }
+// and become assignments to kl_iN.
+//
+// cost model: a callee of size s (statements + expressions) is inlined when
+// s <= threshold, doubled per enclosing loop (up to 3) and again when it is
+// the callee's only call site, 4x for a hot callee under --profile-use
+// (cold ones are never inlined); each caller may grow by 4x its own size plus
+// 4 * threshold. recursive functions, @memo functions, and anything touching
+// strings, arrays or tasks are left alone, and nesting stops at
+// INLINE_MAX_DEPTH. the call under a spawn is never inlined, only its args.
+// a parallel for body counts as a loop; inlined temporaries declared in it
+// stay private to its iterations
+
+#define INLINE_MAX_DEPTH 4
+#define INLINE_MAX_LOOP_BONUS 3
+
+static struct {
+    AST_Program *prog;
+    int threshold;
+    AST_Block **form;    // per function: tail-form copy of its body, NULL = never inline
+    int *size, *sites;
+    int budget;          // growth left for the function being rewritten
+    AST_FuncDecl *stack[INLINE_MAX_DEPTH];
+    int depth;
+    int next_id;
+} I;
+
+static void push(AST_Block *b, AST_Stmt *s) {
+    if (b->count == b->cap) {
+        b->cap = b->cap ? b->cap * 2 : 8;
+        b->stmts = realloc(b->stmts, b->cap * sizeof *b->stmts);
+    }
+    b->stmts[b->count++] = s;
+}
+
+/* ------------------------------------------------------------------ */
+/* copying with renames */
+
+typedef struct { const char **from, **to; int n, cap; } Renames;
+
+static void rename_add(Renames *r, const char *from, const char *to) {
+    if (r->n == r->cap) {
+        r->cap = r->cap ? r->cap * 2 : 8;
+        r->from = realloc(r->from, r->cap * sizeof *r->from);
+        r->to = realloc(r->to, r->cap * sizeof *r->to);
+    }
+    r->from[r->n] = from;
+    r->to[r->n++] = to;
+}
+
+static const char *renamed(const Renames *r, const char *name) {
+    for (int i=0;i<r->n;i++) if (!strcmp(r->from[i], name)) return r->to[i];
+    return name;
+}
+
+static AST_Expr *clone_expr(AST_Expr *e, const Renames *r) {
+    AST_Expr *c = malloc(sizeof *c);
+    *c = *e;
+    switch (e->kind) {
+    case EXPR_IDENT: c->ident = renamed(r, e->ident); break;
+    case EXPR_BIN:
+        c->bin.left = clone_expr(e->bin.left, r);
+        c->bin.right = clone_expr(e->bin.right, r);
+        break;
+    case EXPR_CMP:
+        c->cmp.left = clone_expr(e->cmp.left, r);
+        c->cmp.right = clone_expr(e->cmp.right, r);
+        break;
+    case EXPR_CALL: case EXPR_SPAWN: case EXPR_BUILTIN:
+        c->call.args = malloc((e->call.arg_count ? e->call.arg_count : 1) * sizeof *c->call.args);
+        for (int i=0;i<e->call.arg_count;i++) c->call.args[i] = clone_expr(e->call.args[i], r);
+        break;
+    case EXPR_INDEX:
+        c->index.name = renamed(r, e->index.name);
+        c->index.at = clone_expr(e->index.at, r);
+        break;
+    case EXPR_JOIN: c->join = clone_expr(e->join, r); break;
+    default: break;
+    }
+    return c;
+}
+
+static AST_Block clone_block(AST_Block b, const Renames *r);
+
+static AST_Stmt *clone_stmt(AST_Stmt *s, const Renames *r) {
+    AST_Stmt *c = malloc(sizeof *c);
+    *c = *s;
+    switch (s->kind) {
+    case STMT_VAR:
+        c->var.name = renamed(r, s->var.name);
+        if (s->var.init) c->var.init = clone_expr(s->var.init, r);
+        break;
+    case STMT_ASSIGN:
+        c->assign.name = renamed(r, s->assign.name);
+        c->assign.expr = clone_expr(s->assign.expr, r);
+        if (s->assign.index) c->assign.index = clone_expr(s->assign.index, r);
+        break;
+    case STMT_IF:
+        c->if_.cond = clone_expr(s->if_.cond, r);
+        c->if_.then = clone_block(s->if_.then, r);
+        c->if_.else_ = clone_block(s->if_.else_, r);
+        break;
+    case STMT_WHILE:
+        c->while_.cond = clone_expr(s->while_.cond, r);
+        c->while_.body = clone_block(s->while_.body, r);
+        break;
+    case STMT_PFOR:
+        c->pfor.var = renamed(r, s->pfor.var);
+        c->pfor.lo = clone_expr(s->pfor.lo, r);
+        c->pfor.hi = clone_expr(s->pfor.hi, r);
+        c->pfor.body = clone_block(s->pfor.body, r);
+        break;
+    case STMT_PRINT: c->print = clone_expr(s->print, r); break;
+    case STMT_RETURN: if (s->ret) c->ret = clone_expr(s->ret, r); break;
+    case STMT_EXPR: c->expr = clone_expr(s->expr, r); break;
+    case STMT_FREE: c->free_ = renamed(r, s->free_); break;
+    }
+    return c;
+}
+
+static AST_Block clone_block(AST_Block b, const Renames *r) {
+    AST_Block c = {0};
+    for (int i=0;i<b.count;i++) push(&c, clone_stmt(b.stmts[i], r));
+    return c;
+}
+
+static void local_names(AST_Block b, Renames *r, int id) {
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        if (s->kind == STMT_VAR) {
+            char buf[256];
+            snprintf(buf, sizeof buf, "kl_i%d_%s", id, s->var.name);
+            rename_add(r, s->var.name, strdup(buf));
+        } else if (s->kind == STMT_IF) {
+            local_names(s->if_.then, r, id);
+            local_names(s->if_.else_, r, id);
+        } else if (s->kind == STMT_WHILE) {
+            local_names(s->while_.body, r, id);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* which functions can be inlined */
+
+static bool has_return(AST_Block b) {
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        if (s->kind == STMT_RETURN) return true;
+        if (s->kind == STMT_IF && (has_return(s->if_.then) || has_return(s->if_.else_))) return true;
+        if (s->kind == STMT_WHILE && has_return(s->while_.body)) return true;
+    }
+    return false;
+}
+
+static bool always_returns(AST_Block b) {
+    if (!b.count) return false;
+    AST_Stmt *s = b.stmts[b.count-1];
+    if (s->kind == STMT_RETURN) return true;
+    return s->kind == STMT_IF && always_returns(s->if_.then) && always_returns(s->if_.else_);
+}
+
+// rewrite b so every return is the last statement of its branch
+static bool tail_form(AST_Block *b) {
+    for (int i=0;i<b->count;i++) {
+        AST_Stmt *s = b->stmts[i];
+        bool last = i == b->count-1;
+        switch (s->kind) {
+        case STMT_RETURN:
+            if (!last || !s->ret) return false;
+            break;
+        case STMT_IF:
+            if (!last && !s->if_.else_.count && always_returns(s->if_.then)) {
+                for (int j=i+1;j<b->count;j++) push(&s->if_.else_, b->stmts[j]);
+                b->count = i+1;
+                last = true;
+            }
+            if (!last && (has_return(s->if_.then) || has_return(s->if_.else_))) return false;
+            if (!tail_form(&s->if_.then) || !tail_form(&s->if_.else_)) return false;
+            break;
+        case STMT_WHILE:
+            if (has_return(s->while_.body)) return false;
+            break;
+        default: break;
+        }
+    }
+    return true;
+}
+
+typedef struct { int size; bool ok; } Scan;
+
+static void scan_expr(AST_Expr *e, void *ctx) {
+    Scan *sc = ctx;
+    sc->size++;
+    if (e->ty == TYPE_STRING || e->kind == EXPR_INDEX || e->kind == EXPR_SPAWN || e->kind == EXPR_JOIN)
+        sc->ok = false;
+}
+
+static void scan_stmts(AST_Block b, Scan *sc) {
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        sc->size++;
+        switch (s->kind) {
+        case STMT_VAR: if (s->var.type != TYPE_INT || s->var.len || s->var.manual || s->var.task) sc->ok = false; break;
+        case STMT_ASSIGN: if (s->assign.index) sc->ok = false; break;
+        case STMT_FREE: case STMT_PFOR: sc->ok = false; break;
+        case STMT_IF: scan_stmts(s->if_.then, sc); scan_stmts(s->if_.else_, sc); break;
+        case STMT_WHILE: scan_stmts(s->while_.body, sc); break;
+        default: break;
+        }
+    }
+}
+
+static AST_Block *inline_form(AST_FuncDecl *f, int *size) {
+    Scan sc = { 0, true };
+    scan_stmts(f->body, &sc);
+    ast_visit_block(f->body, scan_expr, &sc);
+    *size = sc.size;
+    if (!sc.ok || f->memo || f->ret_ty != TYPE_INT || !strcmp(f->name, "main")) return NULL;
+    for (int i=0;i<f->param_count;i++) if (f->params[i].type != TYPE_INT) return NULL;
+    if (opt_recursive(I.prog, f)) return NULL;
+    AST_Block *b = malloc(sizeof *b);
+    *b = clone_block(f->body, &(Renames){0});
+    if (!tail_form(b)) { free(b); return NULL; }
+    return b;
+}
+
+static void count_site(AST_Expr *e, void *ctx) {
+    (void)ctx;
+    if (e->kind != EXPR_CALL) return;
+    AST_FuncDecl *f = opt_func(I.prog, e->call.name);
+    if (f) I.sites[f - I.prog->funcs]++;
+}
+
+/* ------------------------------------------------------------------ */
+/* rewriting */
+
+static void inline_block(AST_Block *b, int loop);
+
+static AST_Expr *int_expr(int v, int line) {
+    AST_Expr *e = calloc(1, sizeof *e);
+    e->kind = EXPR_INT;
+    e->line = line;
+    e->ty = TYPE_INT;
+    e->int_lit = v;
+    return e;
+}
+
+static AST_Stmt *new_var(Type ty, const char *name, AST_Expr *init, int line) {
+    AST_Stmt *s = calloc(1, sizeof *s);
+    s->kind = STMT_VAR;
+    s->line = line;
+    s->var.type = ty;
+    s->var.name = name;
+    s->var.init = init;
+    return s;
+}
+
+static void returns_to(AST_Block b, const char *ret) {
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        if (s->kind == STMT_RETURN) {
+            AST_Expr *e = s->ret;
+            s->kind = STMT_ASSIGN;
+            s->assign.name = ret;
+            s->assign.expr = e;
+            s->assign.index = NULL;
+        } else if (s->kind == STMT_IF) {
+            returns_to(s->if_.then, ret);
+            returns_to(s->if_.else_, ret);
+        }
+    }
+}
+
+// replace call e by its callee's body appended to pre; false leaves e a call
+static bool expand(AST_Expr *e, int loop, AST_Block *pre) {
+    AST_FuncDecl *f = opt_func(I.prog, e->call.name);
+    if (!f || I.depth == INLINE_MAX_DEPTH) return false;
+    int k = (int)(f - I.prog->funcs);
+    if (!I.form[k]) return false;
+    for (int i=0;i<I.depth;i++) if (I.stack[i] == f) return false;
+    if (f->cold) return false;  // profile says it never runs, keep callers small
+    int limit = I.threshold << (loop < INLINE_MAX_LOOP_BONUS ? loop : INLINE_MAX_LOOP_BONUS);
+    if (I.sites[k] == 1) limit *= 2;
+    if (f->hot) limit *= 4;
+    if (I.size[k] > limit || I.size[k] > I.budget) return false;
+    I.budget -= I.size[k];
+
+    int id = ++I.next_id;
+    char buf[256];
+    Renames r = {0};
+    for (int i=0;i<f->param_count;i++) {
+        snprintf(buf, sizeof buf, "kl_i%d_%s", id, f->params[i].name);
+        rename_add(&r, f->params[i].name, strdup(buf));
+        push(pre, new_var(TYPE_INT, r.to[i], e->call.args[i], e->line));
+    }
+    local_names(*I.form[k], &r, id);
+    snprintf(buf, sizeof buf, "kl_i%d", id);
+    const char *ret = strdup(buf);
+    push(pre, new_var(TYPE_INT, ret, int_expr(0, e->line), e->line));  // falling off the end returns 0
+
+    AST_Block body = clone_block(*I.form[k], &r);
+    returns_to(body, ret);
+    I.stack[I.depth++] = f;
+    inline_block(&body, loop);
+    I.depth--;
+    for (int i=0;i<body.count;i++) push(pre, body.stmts[i]);
+    free(body.stmts);
+    free(r.from); free(r.to);
+
+    e->kind = EXPR_IDENT;
+    e->ident = ret;
+    return true;
+}
+
+typedef struct { AST_Expr **v; int n, cap; } Calls;
+
+static void add_call(Calls *c, AST_Expr *e) {
+    if (c->n == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 8;
+        c->v = realloc(c->v, c->cap * sizeof *c->v);
+    }
+    c->v[c->n++] = e;
+}
+
+static void collect_call(AST_Expr *e, void *ctx) {
+    if (e->kind == EXPR_CALL) add_call(ctx, e);
+}
+
+// calls left in place ahead of an inlined one run first, as temporaries
+static void hoist(Calls *left, AST_Block *pre) {
+    for (int i=0;i<left->n;i++) {
+        AST_Expr *e = left->v[i], *call = malloc(sizeof *call);
+        *call = *e;
+        char buf[32];
+        snprintf(buf, sizeof buf, "kl_i%d", ++I.next_id);
+        e->kind = EXPR_IDENT;
+        e->ident = strdup(buf);
+        push(pre, new_var(e->ty, e->ident, call, e->line));
+    }
+    left->n = 0;
+}
+
+// the statement's own expressions, not those of nested blocks
+static void stmt_calls(AST_Stmt *s, Calls *c) {
+    switch (s->kind) {
+    case STMT_VAR: if (s->var.init) ast_visit_expr(s->var.init, collect_call, c); break;
+    case STMT_ASSIGN:
+        if (s->assign.index) ast_visit_expr(s->assign.index, collect_call, c);
+        ast_visit_expr(s->assign.expr, collect_call, c);
+        break;
+    case STMT_IF: ast_visit_expr(s->if_.cond, collect_call, c); break;
+    case STMT_WHILE: ast_visit_expr(s->while_.cond, collect_call, c); break;
+    case STMT_PFOR:
+        ast_visit_expr(s->pfor.lo, collect_call, c);
+        ast_visit_expr(s->pfor.hi, collect_call, c);
+        break;
+    case STMT_PRINT: ast_visit_expr(s->print, collect_call, c); break;
+    case STMT_RETURN: if (s->ret) ast_visit_expr(s->ret, collect_call, c); break;
+    case STMT_EXPR: ast_visit_expr(s->expr, collect_call, c); break;
+    case STMT_FREE: break;
+    }
+}
+
+// copy of a while condition's prelude for the end of the body: its
+// variables already exist outside the loop, so declarations become stores
+static AST_Block recompute(AST_Block pre) {
+    AST_Block c = clone_block(pre, &(Renames){0});
+    int n = 0;
+    for (int i=0;i<c.count;i++) {
+        AST_Stmt *s = c.stmts[i];
+        if (s->kind == STMT_VAR) {
+            if (!s->var.init) continue;
+            AST_Expr *e = s->var.init;
+            const char *name = s->var.name;
+            s->kind = STMT_ASSIGN;
+            s->assign.name = name;
+            s->assign.expr = e;
+            s->assign.index = NULL;
+        }
+        c.stmts[n++] = s;
+    }
+    c.count = n;
+    return c;
+}
+
+static void inline_block(AST_Block *b, int loop) {
+    AST_Block out = {0};
+    for (int i=0;i<b->count;i++) {
+        AST_Stmt *s = b->stmts[i];
+        AST_Block pre = {0};
+        Calls calls = {0}, left = {0};
+        stmt_calls(s, &calls);  // post-order: arguments expand before their call
+        for (int j=0;j<calls.n;j++) {
+            AST_Block body = {0};
+            if (!expand(calls.v[j], loop + (s->kind == STMT_WHILE), &body)) {
+                add_call(&left, calls.v[j]);
+                continue;
+            }
+            hoist(&left, &pre);
+            for (int k=0;k<body.count;k++) push(&pre, body.stmts[k]);
+            free(body.stmts);
+        }
+        free(calls.v);
+        free(left.v);
+
+        if (s->kind == STMT_IF) {
+            inline_block(&s->if_.then, loop);
+            inline_block(&s->if_.else_, loop);
+        } else if (s->kind == STMT_WHILE) {
+            inline_block(&s->while_.body, loop + 1);
+            AST_Block again = recompute(pre);
+            for (int j=0;j<again.count;j++) push(&s->while_.body, again.stmts[j]);
+            free(again.stmts);
+        } else if (s->kind == STMT_PFOR) {
+            inline_block(&s->pfor.body, loop + 1);
+        }
+        for (int j=0;j<pre.count;j++) push(&out, pre.stmts[j]);
+        free(pre.stmts);
+        push(&out, s);
+    }
+    free(b->stmts);
+    *b = out;
+}
+
+void inline_calls(AST_Program *p, int threshold) {
+    if (threshold <= 0) return;
+    I.prog = p;
+    I.threshold = threshold;
+    I.form = calloc(p->func_count, sizeof *I.form);
+    I.size = calloc(p->func_count, sizeof *I.size);
+    I.sites = calloc(p->func_count, sizeof *I.sites);
+    for (int i=0;i<p->func_count;i++) {
+        I.form[i] = inline_form(&p->funcs[i], &I.size[i]);
+        ast_visit_block(p->funcs[i].body, count_site, NULL);
+    }
+    for (int i=0;i<p->func_count;i++) {
+        I.budget = 4 * I.size[i] + 4 * threshold;
+        I.depth = 0;
+        inline_block(&p->funcs[i].body, 0);
+    }
+}
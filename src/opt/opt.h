@@ -0,0 +1,16 @@
+#pragma once
+#include "../ast/ast.h"
+
+// call graph helpers, callgraph.c
+AST_FuncDecl *opt_func(AST_Program *p, const char *name);
+bool opt_recursive(AST_Program *p, AST_FuncDecl *f);  // f can reach a call to itself
+void opt_prune(AST_Program *p);  // drop functions main can't reach, reorder the rest
+
+void inline_calls(AST_Program *p, int threshold);  // after sema, 0 = off
+void range_analyze(AST_Program *p);  // after sema, needs expr types and array lengths
+void purity_analyze(AST_Program *p, bool auto_memo);  // after range_analyze, auto_memo = --memo
+
+// profile-guided optimisation, profile.c
+void profile_number(AST_Program *p);  // right after parse, numbers if/while branches
+void profile_load(AST_Program *p, const char *path);  // --profile-use, before inlining
+void profile_order(AST_Program *p);   // --profile-use, hottest functions first, just before cgen
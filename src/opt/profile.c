@@ -0,0 +1,100 @@
+#include "opt.h"
+#include "../utils/die.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// profile-guided optimisation. every if/while gets an entry in the
+// program's branch table named by (function, ordinal), so a profile taken
+// from one build still applies after -O, inlining or unrelated functions
+// change; a branch whose line moved is ignored as stale.
+// from the profile (see rt/prof.h for the format):
+//   - conditions true or false in >= PGO_BIAS of at least PGO_MIN_SAMPLES
+//     evaluations get __builtin_expect
+//   - functions called at least max_calls / PGO_HOT_DIV times are hot, ones
+//     the profile saw but never called are cold; cgen marks them and the
+//     inliner favours hot callees and leaves cold ones alone
+//   - profile_order sorts the output hottest first
+
+#define PGO_MIN_SAMPLES 100
+#define PGO_BIAS 0.9
+#define PGO_HOT_DIV 10
+#define PGO_HOT_MIN 1000
+
+static void number_block(AST_Program *p, AST_FuncDecl *f, AST_Block b, int *ordinal) {
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        if (s->kind == STMT_PFOR) number_block(p, f, s->pfor.body, ordinal);
+        if (s->kind != STMT_IF && s->kind != STMT_WHILE) continue;
+        p->branches = realloc(p->branches, (p->branch_count + 1) * sizeof *p->branches);
+        p->branches[p->branch_count] = (AST_Branch){ f->name, (*ordinal)++, s->line, 0 };
+        s->branch = p->branch_count++;
+        if (s->kind == STMT_IF) {
+            number_block(p, f, s->if_.then, ordinal);
+            number_block(p, f, s->if_.else_, ordinal);
+        } else {
+            number_block(p, f, s->while_.body, ordinal);
+        }
+    }
+}
+
+void profile_number(AST_Program *p) {
+    p->branch_count = 1;  // 0 = not a branch
+    p->branches = calloc(1, sizeof *p->branches);
+    for (int i=0;i<p->func_count;i++) {
+        int ordinal = 0;
+        number_block(p, &p->funcs[i], p->funcs[i].body, &ordinal);
+    }
+}
+
+static AST_Branch *find_branch(AST_Program *p, const char *func, int ordinal) {
+    for (int i=1;i<p->branch_count;i++)
+        if (p->branches[i].ordinal == ordinal && !strcmp(p->branches[i].func, func))
+            return &p->branches[i];
+    return NULL;
+}
+
+void profile_load(AST_Program *p, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) die("open profile %s", path);
+    char line[512], name[256];
+    unsigned long long calls = 0, yes, no;
+    int ordinal, at;
+    bool *seen = calloc(p->func_count, sizeof *seen);
+    while (fgets(line, sizeof line, f)) {
+        if (sscanf(line, "func %255s %llu", name, &calls) == 2) {
+            AST_FuncDecl *fn = opt_func(p, name);
+            if (!fn) continue;
+            fn->calls = calls;
+            seen[fn - p->funcs] = true;
+        } else if (sscanf(line, "branch %255s %d %d %llu %llu", name, &ordinal, &at, &yes, &no) == 5) {
+            AST_Branch *b = find_branch(p, name, ordinal);
+            if (!b || b->line != at || yes + no < PGO_MIN_SAMPLES) continue;
+            if (yes >= PGO_BIAS * (yes + no)) b->expect = 1;
+            else if (no >= PGO_BIAS * (yes + no)) b->expect = -1;
+        } else {
+            die("%s: bad profile line: %s", path, line);
+        }
+    }
+    fclose(f);
+
+    uint64_t max = 0;
+    for (int i=0;i<p->func_count;i++) if (p->funcs[i].calls > max) max = p->funcs[i].calls;
+    for (int i=0;i<p->func_count;i++) {
+        AST_FuncDecl *fn = &p->funcs[i];
+        if (!strcmp(fn->name, "main")) continue;
+        fn->hot = fn->calls >= PGO_HOT_MIN && fn->calls >= max / PGO_HOT_DIV;
+        fn->cold = seen[i] && !fn->calls;
+    }
+    free(seen);
+}
+
+static int by_calls(const void *a, const void *b) {
+    const AST_FuncDecl *x = a, *y = b;
+    if (x->calls != y->calls) return x->calls > y->calls ? -1 : 1;
+    return x->line - y->line;  // qsort isn't stable, keep source order among equals
+}
+
+void profile_order(AST_Program *p) {
+    qsort(p->funcs, p->func_count, sizeof *p->funcs, by_calls);
+}
@@ -0,0 +1,115 @@
+#include "opt.h"
+#include "../utils/die.h"
+#include <stdlib.h>
+#include <string.h>
+
+// interprocedural purity: every function starts out const and is demoted by
+// what its body does and by its callees until nothing changes. cgen turns
+// the result into __attribute__((const/pure)) so the c compiler can merge,
+// hoist and drop calls. a function keeps no attribute when it
+//   - prints, or evaluates a string '+' (allocates)
+//   - has a while loop or is recursive (may not return), or has a checked
+//     index (may abort)
+//   - has a parallel for, spawn or join (starts threads, waits)
+//   - calls a function that keeps no attribute
+// comparing string contents reads memory, which demotes const to pure.
+// main is the program's effect and is never marked. memoization only needs
+// no side effects, so it is decided before recursion is counted: a call
+// that never returns never fills its cache slot either
+
+static AST_Program *prog;
+static bool *loops;  // per function: recursive, counted once may_loop is set
+static bool may_loop;
+
+static void lower(Purity *p, Purity to) {
+    if (to < *p) *p = to;
+}
+
+static void expr_purity(AST_Expr *e, void *ctx) {
+    Purity *p = ctx;
+    switch (e->kind) {
+    case EXPR_BIN:
+        if (e->ty == TYPE_STRING) lower(p, PURITY_NONE);
+        break;
+    case EXPR_CMP:
+        if (e->cmp.left->ty == TYPE_STRING) lower(p, PURITY_PURE);
+        break;
+    case EXPR_INDEX:
+        if (!e->index.unchecked) lower(p, PURITY_NONE);
+        break;
+    case EXPR_CALL: {
+        AST_FuncDecl *f = opt_func(prog, e->call.name);
+        lower(p, f ? f->purity : PURITY_NONE);
+        break;
+    }
+    case EXPR_SPAWN: case EXPR_JOIN:
+        lower(p, PURITY_NONE);
+        break;
+    default: break;
+    }
+}
+
+// statements with effects of their own, expressions are visited separately
+static void stmt_purity(AST_Block b, Purity *p) {
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        switch (s->kind) {
+        case STMT_PRINT: case STMT_WHILE: case STMT_PFOR: lower(p, PURITY_NONE); break;
+        case STMT_IF: stmt_purity(s->if_.then, p); stmt_purity(s->if_.else_, p); break;
+        default: break;
+        }
+    }
+}
+
+static Purity func_purity(AST_FuncDecl *f) {
+    if (!strcmp(f->name, "main")) return PURITY_NONE;
+    Purity p = f->purity;
+    if (may_loop && loops[f - prog->funcs]) lower(&p, PURITY_NONE);
+    stmt_purity(f->body, &p);
+    ast_visit_block(f->body, expr_purity, &p);
+    return p;
+}
+
+/* ------------------------------------------------------------------ */
+/* memoization */
+
+// a cached result must be a pure function of int arguments
+static bool memo_ok(AST_FuncDecl *f) {
+    if (f->purity == PURITY_NONE || f->ret_ty != TYPE_INT || !f->param_count) return false;
+    for (int i=0;i<f->param_count;i++)
+        if (f->params[i].type != TYPE_INT) return false;
+    return true;
+}
+
+static void settle(void) {
+    bool changed;
+    do {  // purity only ever goes down, so this terminates
+        changed = false;
+        for (int i=0;i<prog->func_count;i++) {
+            Purity q = func_purity(&prog->funcs[i]);
+            if (q != prog->funcs[i].purity) { prog->funcs[i].purity = q; changed = true; }
+        }
+    } while (changed);
+}
+
+void purity_analyze(AST_Program *p, bool auto_memo) {
+    prog = p;
+    loops = malloc((p->func_count ? p->func_count : 1) * sizeof *loops);
+    for (int i=0;i<p->func_count;i++) {
+        p->funcs[i].purity = PURITY_CONST;
+        loops[i] = p->funcs[i].recursive = opt_recursive(p, &p->funcs[i]);
+    }
+    may_loop = false;
+    settle();
+
+    for (int i=0;i<p->func_count;i++) {
+        AST_FuncDecl *f = &p->funcs[i];
+        if (f->memo && !memo_ok(f))
+            die("line %d: @memo needs a side-effect free function of int args returning int", f->line);
+        if (auto_memo && memo_ok(f) && loops[i]) f->memo = true;
+    }
+
+    may_loop = true;  // callers of a recursive function may not return either
+    settle();
+    free(loops);
+}
@@ -0,0 +1,189 @@
+#include "opt.h"
+#include "../lexer/lexer.h"  // comparison and operator token kinds
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// range analysis for array indices: constant indices are checked here,
+// the rest are driven by while loop induction variables. a loop qualifies
+// when it looks like
+//     while (v < B) { ...; v = v + S; }    (or v <= B)
+// with that final statement the only write to v and B, S loop invariant.
+// inside the body v stays in [entry, hi], hi = B or B - 1, as long as
+// entry >= 0 and S >= 0 (and v + S can't overflow), so a[v]:
+//   - needs no check at all when entry, S and B are constants and hi < len
+//   - otherwise, in an innermost loop, is covered by one test before the
+//     loop: codegen emits an unchecked copy of the loop under that test and
+//     keeps the checked one for when it fails
+// a parallel for's variable never leaves [lo, hi), so a[i] is proved when
+// both are constants and otherwise tested once per chunk the same way.
+// the same facts bound the trip count: an innermost loop of constant entry,
+// bound and step that runs under RANGE_SHORT_TRIP times is marked short_trip
+// and codegen leaves out its gc poll, which would keep the c compiler from
+// vectorizing it; the enclosing loop still polls
+
+#define RANGE_SHORT_TRIP 65536
+
+static int loops;  // versioned loop ids, 0 = none
+
+static bool is_var(AST_Expr *e, const char *name) {
+    return e->kind == EXPR_IDENT && !strcmp(e->ident, name);
+}
+
+// writes to scalar name anywhere in b
+static int assigns(AST_Block b, const char *name) {
+    int n = 0;
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        switch (s->kind) {
+        case STMT_ASSIGN: n += !s->assign.index && !strcmp(s->assign.name, name); break;
+        case STMT_IF: n += assigns(s->if_.then, name) + assigns(s->if_.else_, name); break;
+        case STMT_WHILE: n += assigns(s->while_.body, name); break;
+        case STMT_PFOR: n += assigns(s->pfor.body, name); break;
+        default: break;
+        }
+    }
+    return n;
+}
+
+static bool has_loop(AST_Block b) {
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        if (s->kind == STMT_WHILE || s->kind == STMT_PFOR) return true;
+        if (s->kind == STMT_IF && (has_loop(s->if_.then) || has_loop(s->if_.else_))) return true;
+    }
+    return false;
+}
+
+// constant or not written in the loop body
+static bool invariant(AST_Expr *e, AST_Block body) {
+    return e->kind == EXPR_INT || (e->kind == EXPR_IDENT && !assigns(body, e->ident));
+}
+
+// the statement before the loop sets v to a constant
+static bool entry_const(AST_Stmt *prev, const char *v, int *c) {
+    if (!prev) return false;
+    AST_Expr *e = NULL;
+    if (prev->kind == STMT_VAR && !strcmp(prev->var.name, v)) e = prev->var.init;
+    if (prev->kind == STMT_ASSIGN && !prev->assign.index && !strcmp(prev->assign.name, v)) e = prev->assign.expr;
+    if (!e || e->kind != EXPR_INT) return false;
+    *c = e->int_lit;
+    return true;
+}
+
+typedef struct {
+    const char *var;
+    long hi;        // valid when bound is constant
+    bool hi_known, proved;
+    int loop;
+    int min_len;    // shortest array indexed by var
+} Facts;
+
+static void collect(AST_Expr *e, void *ctx) {
+    Facts *f = ctx;
+    if (e->kind != EXPR_INDEX || !is_var(e->index.at, f->var)) return;
+    if (f->proved && f->hi < e->index.len) { e->index.unchecked = true; return; }
+    if (!f->min_len || e->index.len < f->min_len) f->min_len = e->index.len;
+    if (f->loop && !e->index.unchecked) e->index.loop = f->loop;
+}
+
+static void analyze(AST_Stmt *s, AST_Stmt *prev) {
+    AST_Expr *c = s->while_.cond;
+    AST_Block body = s->while_.body;
+    if (c->kind != EXPR_CMP || (c->cmp.cmp != TOK_LT && c->cmp.cmp != TOK_LE)) return;
+    if (c->cmp.left->kind != EXPR_IDENT || !body.count) return;
+    const char *v = c->cmp.left->ident;
+    AST_Expr *bound = c->cmp.right;
+
+    AST_Stmt *inc = body.stmts[body.count-1];
+    if (inc->kind != STMT_ASSIGN || inc->assign.index || strcmp(inc->assign.name, v)) return;
+    AST_Expr *e = inc->assign.expr;
+    if (e->kind != EXPR_BIN || e->bin.op != TOK_PLUS || !is_var(e->bin.left, v)) return;
+    AST_Expr *step = e->bin.right;
+    if (assigns(body, v) != 1 || is_var(bound, v) || is_var(step, v)) return;
+    if (!invariant(bound, body) || !invariant(step, body)) return;
+    if (step->kind == EXPR_INT && step->int_lit < 0) return;
+
+    bool inclusive = c->cmp.cmp == TOK_LE;
+    Facts f = { .var = v };
+    if (bound->kind == EXPR_INT) {
+        f.hi = inclusive ? bound->int_lit : (long)bound->int_lit - 1;
+        f.hi_known = true;
+    }
+    int entry;
+    bool counted = f.hi_known && step->kind == EXPR_INT && entry_const(prev, v, &entry);
+    f.proved = counted && entry >= 0 && step->int_lit <= INT_MAX - f.hi;
+    s->while_.short_trip = counted && step->int_lit > 0 && !has_loop(body) &&
+                           (f.hi - entry) / step->int_lit < RANGE_SHORT_TRIP;
+    ast_visit_block(body, collect, &f);
+    if (!f.min_len || has_loop(body)) return;  // nothing left to check, or not innermost
+
+    // the fast path would never be taken
+    if (f.hi_known && f.hi >= f.min_len) return;
+    if (step->kind == EXPR_INT && step->int_lit > INT_MAX - f.min_len) return;
+
+    AST_Guard *g = calloc(1, sizeof *g);
+    g->loop = f.loop = ++loops;
+    g->var = v;
+    g->step = step->kind == EXPR_INT ? NULL : step;
+    g->bound = f.hi_known ? NULL : bound;
+    g->inclusive = inclusive;
+    g->len = f.min_len;
+    s->while_.guard = g;
+    f.proved = false;
+    ast_visit_block(body, collect, &f);
+}
+
+static void analyze_par(AST_Stmt *s) {
+    AST_Expr *lo = s->pfor.lo, *hi = s->pfor.hi;
+    Facts f = { .var = s->pfor.var };
+    if (hi->kind == EXPR_INT) {
+        f.hi = (long)hi->int_lit - 1;
+        f.hi_known = true;
+    }
+    f.proved = f.hi_known && lo->kind == EXPR_INT && lo->int_lit >= 0;
+    s->pfor.short_trip = f.hi_known && lo->kind == EXPR_INT && !has_loop(s->pfor.body) &&
+                         f.hi - lo->int_lit < RANGE_SHORT_TRIP;
+    ast_visit_block(s->pfor.body, collect, &f);
+    if (!f.min_len || has_loop(s->pfor.body)) return;
+    if (f.hi_known && f.hi >= f.min_len) return;
+
+    AST_Guard *g = calloc(1, sizeof *g);
+    g->loop = f.loop = ++loops;
+    g->var = s->pfor.var;
+    g->len = f.min_len;
+    s->pfor.guard = g;
+    f.proved = false;
+    ast_visit_block(s->pfor.body, collect, &f);
+}
+
+// a[3] with 3 < len
+static void const_index(AST_Expr *e, void *ctx) {
+    (void)ctx;
+    if (e->kind == EXPR_INDEX && e->index.at->kind == EXPR_INT &&
+        e->index.at->int_lit >= 0 && e->index.at->int_lit < e->index.len)
+        e->index.unchecked = true;
+}
+
+static void range_block(AST_Block b) {
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        if (s->kind == STMT_WHILE) {
+            analyze(s, i ? b.stmts[i-1] : NULL);
+            range_block(s->while_.body);
+        } else if (s->kind == STMT_PFOR) {
+            analyze_par(s);
+            range_block(s->pfor.body);
+        } else if (s->kind == STMT_IF) {
+            range_block(s->if_.then);
+            range_block(s->if_.else_);
+        }
+    }
+}
+
+void range_analyze(AST_Program *p) {
+    for (int i=0;i<p->func_count;i++) {
+        ast_visit_block(p->funcs[i].body, const_index, NULL);
+        range_block(p->funcs[i].body);
+    }
+}
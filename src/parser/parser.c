@@ -1,6 +1,7 @@
 #include "parser.h"
 #include "../utils/die.h"
 #include "../ast/ast.h"
+#include <math.h>  // isinf, a macro, no libm
 #include <stdlib.h>
 #include <string.h>
 
@@ -53,43 +54,118 @@ static void block_append(AST_Block *b, AST_Stmt *s) {
 /* ------------------------------------------------------------------ */
 /* type parsing */
 
-// parses int or string types
+// type keywords, also usable as conversions: float(x), float4(a, b, c, d)
+static const struct { TokenKind tok; Type ty; } types[] = {
+    { TOK_INT, TYPE_INT }, { TOK_STRING, TYPE_STRING },
+    { TOK_FLOAT, TYPE_FLOAT }, { TOK_DOUBLE, TYPE_DOUBLE },
+    { TOK_FLOAT4, TYPE_FLOAT4 }, { TOK_INT4, TYPE_INT4 }, { TOK_FLOAT8, TYPE_FLOAT8 },
+};
+
+static bool at_type(Parser *p) {
+    for (size_t i = 0; i < sizeof types / sizeof types[0]; i++)
+        if (match(p, types[i].tok)) return true;
+    return false;
+}
+
+// parses a type keyword
 // could support user-defined or array types
 static Type parse_type(Parser *p) {
-    if (match(p, TOK_INT)) {
-        next(p);
-        return TYPE_INT;
-    }
-    if (match(p, TOK_STRING)) {
-        next(p);
-        return TYPE_STRING;
-    }
+    for (size_t i = 0; i < sizeof types / sizeof types[0]; i++)
+        if (match(p, types[i].tok)) {
+            next(p);
+            return types[i].ty;
+        }
     die("line %d: type expected", p->cur.line);
     return TYPE_VOID;   // unreachable fallback
 }
 
+// horizontal reductions over a vector's lanes, names no function may take
+static bool is_builtin(const char *name) {
+    return !strcmp(name, "hsum") || !strcmp(name, "hmin") || !strcmp(name, "hmax");
+}
+
 /* ------------------------------------------------------------------ */
 /* expressions */
 
 // create new expr of kind k
 // calloc used to zero init
-static AST_Expr *new_expr(ExprKind k) {
+static AST_Expr *new_expr(ExprKind k, int line) {
     AST_Expr *e = calloc(1, sizeof *e);
     e->kind = k;
+    e->line = line;
     return e;
 }
 
-// parse literals, identifiers, calls, or parenthesized expressions
-// no unary ops or indexing yet
+// parse the argument list of a call, current token is '('
+static AST_Expr *parse_call(Parser *p, const char *name, int line) {
+    expect(p, TOK_LPAREN);
+    AST_Expr *e = new_expr(EXPR_CALL, line);
+    e->call.name = strdup(name);
+    e->call.args = NULL;
+    e->call.arg_count = 0;
+
+    if (!match(p, TOK_RPAREN)) {
+        do {
+            // grow arg list
+            if (e->call.arg_count == 0)
+                e->call.args = malloc(sizeof *e->call.args);
+            else
+                e->call.args = realloc(e->call.args,
+                    (e->call.arg_count + 1) * sizeof *e->call.args);
+            e->call.args[e->call.arg_count++] = parse_expr(p);
+        } while (match(p, TOK_COMMA) && (next(p), 1));
+    }
+    expect(p, TOK_RPAREN);
+    return e;
+}
+
+// parse name[expr], current token is '['
+static AST_Expr *parse_index(Parser *p, const char *name, int line) {
+    expect(p, TOK_LBRACKET);
+    AST_Expr *e = new_expr(EXPR_INDEX, line);
+    e->index.name = strdup(name);
+    e->index.at = parse_expr(p);
+    expect(p, TOK_RBRACKET);
+    return e;
+}
+
+// parse literals, identifiers, calls, indexing, unary minus or
+// parenthesized expressions
 static AST_Expr *parse_primary(Parser *p) {
+    int line = p->cur.line;
+    if (match(p, TOK_MINUS)) {  // -x is 0 - x, -5 stays a literal
+        next(p);
+        AST_Expr *operand = parse_primary(p);
+        if (operand->kind == EXPR_INT) { operand->int_lit = -operand->int_lit; return operand; }
+        if (operand->kind == EXPR_FLOAT) { operand->float_lit = -operand->float_lit; return operand; }
+        AST_Expr *e = new_expr(EXPR_BIN, line);
+        e->bin.left = new_expr(EXPR_INT, line);
+        e->bin.right = operand;
+        e->bin.op = TOK_MINUS;
+        return e;
+    }
     if (match(p, TOK_INT_LIT)) {
-        AST_Expr *e = new_expr(EXPR_INT);
+        AST_Expr *e = new_expr(EXPR_INT, line);
         e->int_lit = atoi(p->cur.text.p);
         next(p);
         return e;
     }
+    if (match(p, TOK_FLOAT_LIT)) {
+        AST_Expr *e = new_expr(EXPR_FLOAT, line);
+        e->float_lit = strtod(p->cur.text.p, NULL);
+        if (isinf(e->float_lit)) die("line %d: float literal out of range", line);
+        next(p);
+        return e;
+    }
+    if (at_type(p)) {  // float(x), float4(x) splat, float4(a, b, c, d)
+        const char *name = p->cur.text.p;
+        next(p);
+        AST_Expr *e = parse_call(p, name, line);
+        e->kind = EXPR_BUILTIN;
+        return e;
+    }
     if (match(p, TOK_STR_LIT)) {
-        AST_Expr *e = new_expr(EXPR_STR);
+        AST_Expr *e = new_expr(EXPR_STR, line);
         e->str_lit = strdup(p->cur.text.p);
         next(p);
         return e;
@@ -98,32 +174,33 @@ static AST_Expr *parse_primary(Parser *p) {
         const char *name = p->cur.text.p;
         next(p);
         if (match(p, TOK_LPAREN)) {
-            // parse function call
-            next(p);
-            AST_Expr *e = new_expr(EXPR_CALL);
-            e->call.name = strdup(name);
-            e->call.args = NULL;
-            e->call.arg_count = 0;
-
-            if (!match(p, TOK_RPAREN)) {
-                do {
-                    // grow arg list
-                    if (e->call.arg_count == 0)
-                        e->call.args = malloc(sizeof *e->call.args);
-                    else
-                        e->call.args = realloc(e->call.args,
-                            (e->call.arg_count + 1) * sizeof *e->call.args);
-                    e->call.args[e->call.arg_count++] = parse_expr(p);
-                } while (match(p, TOK_COMMA) && (next(p), 1));
-            }
-            expect(p, TOK_RPAREN);
+            AST_Expr *e = parse_call(p, name, line);
+            if (is_builtin(name)) e->kind = EXPR_BUILTIN;
             return e;
+        } else if (match(p, TOK_LBRACKET)) {
+            return parse_index(p, name, line);
         } else {
-            AST_Expr *e = new_expr(EXPR_IDENT);
+            AST_Expr *e = new_expr(EXPR_IDENT, line);
             e->ident = strdup(name);
             return e;
         }
     }
+    if (match(p, TOK_SPAWN)) {  // spawn f(args)
+        next(p);
+        const char *name = p->cur.text.p;
+        expect(p, TOK_IDENT);
+        AST_Expr *e = parse_call(p, name, line);
+        e->kind = EXPR_SPAWN;
+        return e;
+    }
+    if (match(p, TOK_JOIN)) {  // join(t) or join(ts[i])
+        next(p);
+        expect(p, TOK_LPAREN);
+        AST_Expr *e = new_expr(EXPR_JOIN, line);
+        e->join = parse_expr(p);
+        expect(p, TOK_RPAREN);
+        return e;
+    }
     if (match(p, TOK_LPAREN)) {
         next(p);
         AST_Expr *e = parse_expr(p);
@@ -134,32 +211,32 @@ static AST_Expr *parse_primary(Parser *p) {
     return NULL;
 }
 
-// parse comparison expressions
-// left-associative; can extend precedence support
-static AST_Expr *parse_cmp(Parser *p) {
+// parse * and /, binds tighter than + and -
+static AST_Expr *parse_mul(Parser *p) {
     AST_Expr *left = parse_primary(p);
-    while (match(p, TOK_EQ) || match(p, TOK_NE) || match(p, TOK_LT) ||
-           match(p, TOK_LE) || match(p, TOK_GT) || match(p, TOK_GE)) {
+    while (match(p, TOK_STAR) || match(p, TOK_SLASH)) {
         TokenKind op = p->cur.kind;
+        int line = p->cur.line;
         next(p);
         AST_Expr *right = parse_primary(p);
-        AST_Expr *e = new_expr(EXPR_CMP);
-        e->cmp.left = left;
-        e->cmp.right = right;
-        e->cmp.cmp = op;
+        AST_Expr *e = new_expr(EXPR_BIN, line);
+        e->bin.left = left;
+        e->bin.right = right;
+        e->bin.op = op;
         left = e;
     }
     return left;
 }
 
-// parse full expression with + and -
-static AST_Expr *parse_expr(Parser *p) {
-    AST_Expr *left = parse_cmp(p);
+// parse + and -
+static AST_Expr *parse_add(Parser *p) {
+    AST_Expr *left = parse_mul(p);
     while (match(p, TOK_PLUS) || match(p, TOK_MINUS)) {
         TokenKind op = p->cur.kind;
+        int line = p->cur.line;
         next(p);
-        AST_Expr *right = parse_cmp(p);
-        AST_Expr *e = new_expr(EXPR_BIN);
+        AST_Expr *right = parse_mul(p);
+        AST_Expr *e = new_expr(EXPR_BIN, line);
         e->bin.left = left;
         e->bin.right = right;
         e->bin.op = op;
@@ -168,28 +245,62 @@ static AST_Expr *parse_expr(Parser *p) {
     return left;
 }
 
+// parse full expression, comparisons bind loosest
+// left-associative like c, a < b < c compares the 0/1 result
+static AST_Expr *parse_expr(Parser *p) {
+    AST_Expr *left = parse_add(p);
+    while (match(p, TOK_EQ) || match(p, TOK_NE) || match(p, TOK_LT) ||
+           match(p, TOK_LE) || match(p, TOK_GT) || match(p, TOK_GE)) {
+        TokenKind op = p->cur.kind;
+        int line = p->cur.line;
+        next(p);
+        AST_Expr *right = parse_add(p);
+        AST_Expr *e = new_expr(EXPR_CMP, line);
+        e->cmp.left = left;
+        e->cmp.right = right;
+        e->cmp.cmp = op;
+        left = e;
+    }
+    return left;
+}
+
 /* ------------------------------------------------------------------ */
 /* statements */
 
 // alloc new stmt of kind k
-static AST_Stmt *new_stmt(StmtKind k) {
+static AST_Stmt *new_stmt(StmtKind k, int line) {
     AST_Stmt *s = calloc(1, sizeof *s);
     s->kind = k;
+    s->line = line;
     return s;
 }
 
-// parse var decl (manual or not)
+// parse var decl (manual, task or plain)
 // no const or mutability flags yet
 static AST_VarDecl parse_vardecl(Parser *p) {
     AST_VarDecl vd = {0};
     if (match(p, TOK_MANUAL)) {
         vd.manual = true;
         next(p);
+    } else if (match(p, TOK_TASK)) {  // task int t = spawn f(x);
+        vd.task = true;
+        next(p);
     }
     vd.type = parse_type(p);
     vd.name = strdup(p->cur.text.p);
     expect(p, TOK_IDENT);
 
+    if (match(p, TOK_LBRACKET)) {  // T name[len]; no initialiser
+        next(p);
+        if (!match(p, TOK_INT_LIT)) die("line %d: array length expected", p->cur.line);
+        vd.len = atoi(p->cur.text.p);
+        if (vd.len <= 0) die("line %d: array length must be positive", p->cur.line);
+        next(p);
+        expect(p, TOK_RBRACKET);
+        expect(p, TOK_SEMI);
+        return vd;
+    }
+
     if (match(p, TOK_ASSIGN)) {
         next(p);
         vd.init = parse_expr(p);
@@ -207,75 +318,156 @@ static AST_Param parse_param(Parser *p) {
     return param;
 }
 
+static AST_Stmt *parse_stmt(Parser *p);
+
+// parse if with optional else / else if, current token is 'if'
+static AST_Stmt *parse_if(Parser *p) {
+    AST_Stmt *s = new_stmt(STMT_IF, p->cur.line);
+    expect(p, TOK_IF);
+    expect(p, TOK_LPAREN);
+    s->if_.cond = parse_expr(p);
+    expect(p, TOK_RPAREN);
+    s->if_.then = parse_block(p);
+    if (match(p, TOK_ELSE)) {
+        next(p);
+        if (match(p, TOK_IF))  // else if: a nested if as the whole else block
+            block_append(&s->if_.else_, parse_if(p));
+        else
+            s->if_.else_ = parse_block(p);
+    }
+    return s;
+}
+
+// expect the loop variable of a parallel for
+static void expect_var(Parser *p, const char *name) {
+    if (!match(p, TOK_IDENT) || strcmp(p->cur.text.p, name))
+        die("line %d: parallel for must use %s as its variable", p->cur.line, name);
+    next(p);
+}
+
+// parallel for (int i = lo; i < hi; i = i + 1) { ... }, current token is 'parallel'
+// only this counting form is accepted, so iterations can be split into ranges
+static AST_Stmt *parse_pfor(Parser *p) {
+    AST_Stmt *s = new_stmt(STMT_PFOR, p->cur.line);
+    expect(p, TOK_PARALLEL);
+    expect(p, TOK_FOR);
+    expect(p, TOK_LPAREN);
+    expect(p, TOK_INT);
+    const char *name = strdup(p->cur.text.p);
+    s->pfor.var = name;
+    expect(p, TOK_IDENT);
+    expect(p, TOK_ASSIGN);
+    s->pfor.lo = parse_expr(p);
+    expect(p, TOK_SEMI);
+    expect_var(p, name);
+    expect(p, TOK_LT);
+    s->pfor.hi = parse_expr(p);
+    expect(p, TOK_SEMI);
+    expect_var(p, name);
+    expect(p, TOK_ASSIGN);
+    expect_var(p, name);
+    if (!match(p, TOK_PLUS) || (next(p), !match(p, TOK_INT_LIT)) || atoi(p->cur.text.p) != 1)
+        die("line %d: parallel for must step by %s = %s + 1", p->cur.line, name, name);
+    next(p);
+    expect(p, TOK_RPAREN);
+    s->pfor.body = parse_block(p);
+    return s;
+}
+
+// parse a single statement
+static AST_Stmt *parse_stmt(Parser *p) {
+    AST_Stmt *s = NULL;
+    int line = p->cur.line;
+    if (at_type(p) || match(p, TOK_MANUAL) || match(p, TOK_TASK)) {
+        s = new_stmt(STMT_VAR, line);
+        s->var = parse_vardecl(p);
+    } else if (match(p, TOK_IDENT)) {
+        // parse assignment or call statement
+        const char *name = p->cur.text.p;
+        next(p);
+        if (match(p, TOK_LPAREN)) {
+            s = new_stmt(STMT_EXPR, line);
+            s->expr = parse_call(p, name, line);
+            expect(p, TOK_SEMI);
+            return s;
+        }
+        AST_Expr *index = match(p, TOK_LBRACKET) ? parse_index(p, name, line) : NULL;
+        expect(p, TOK_ASSIGN);
+        s = new_stmt(STMT_ASSIGN, line);
+        s->assign.name = strdup(name);
+        s->assign.index = index;
+        s->assign.expr = parse_expr(p);
+        expect(p, TOK_SEMI);
+    } else if (match(p, TOK_IF)) {
+        s = parse_if(p);
+    } else if (match(p, TOK_WHILE)) {
+        next(p);
+        expect(p, TOK_LPAREN);
+        s = new_stmt(STMT_WHILE, line);
+        s->while_.cond = parse_expr(p);
+        expect(p, TOK_RPAREN);
+        s->while_.body = parse_block(p);
+    } else if (match(p, TOK_PARALLEL)) {
+        s = parse_pfor(p);
+    } else if (match(p, TOK_JOIN)) {  // join(t); just waits
+        s = new_stmt(STMT_EXPR, line);
+        s->expr = parse_expr(p);
+        expect(p, TOK_SEMI);
+    } else if (match(p, TOK_PRINT)) {
+        next(p);
+        expect(p, TOK_LPAREN);
+        s = new_stmt(STMT_PRINT, line);
+        s->print = parse_expr(p);
+        expect(p, TOK_RPAREN);
+        expect(p, TOK_SEMI);
+    } else if (match(p, TOK_FREE)) {
+        next(p);
+        expect(p, TOK_LPAREN);
+        s = new_stmt(STMT_FREE, line);
+        s->free_ = strdup(p->cur.text.p);
+        expect(p, TOK_IDENT);
+        expect(p, TOK_RPAREN);
+        expect(p, TOK_SEMI);
+    } else if (match(p, TOK_RETURN)) {
+        next(p);
+        s = new_stmt(STMT_RETURN, line);
+        s->ret = NULL;
+        if (!match(p, TOK_SEMI))
+            s->ret = parse_expr(p);
+        expect(p, TOK_SEMI);
+    } else {
+        die("line %d: statement expected", p->cur.line);
+    }
+    return s;
+}
+
 // parse block of statements
 // could track scope depth for nesting
 static AST_Block parse_block(Parser *p) {
     AST_Block b = {0};
     expect(p, TOK_LBRACE);
-    while (!match(p, TOK_RBRACE)) {
-        AST_Stmt *s = NULL;
-        if (match(p, TOK_INT) || match(p, TOK_STRING) || match(p, TOK_MANUAL)) {
-            s = new_stmt(STMT_VAR);
-            s->var = parse_vardecl(p);
-        } else if (match(p, TOK_IDENT)) {
-            // parse assignment
-            const char *name = p->cur.text.p;
-            next(p);
-            expect(p, TOK_ASSIGN);
-            s = new_stmt(STMT_ASSIGN);
-            s->assign.name = strdup(name);
-            s->assign.expr = parse_expr(p);
-            expect(p, TOK_SEMI);
-        } else if (match(p, TOK_IF)) {
-            next(p);
-            expect(p, TOK_LPAREN);
-            s = new_stmt(STMT_IF);
-            s->if_.cond = parse_expr(p);
-            expect(p, TOK_RPAREN);
-            s->if_.then = parse_block(p);
-            s->if_.else_.count = 0;
-            s->if_.else_.stmts = NULL;
-            if (match(p, TOK_ELSE)) {
-                next(p);
-                s->if_.else_ = parse_block(p);
-            }
-        } else if (match(p, TOK_WHILE)) {
-            next(p);
-            expect(p, TOK_LPAREN);
-            s = new_stmt(STMT_WHILE);
-            s->while_.cond = parse_expr(p);
-            expect(p, TOK_RPAREN);
-            s->while_.body = parse_block(p);
-        } else if (match(p, TOK_PRINT)) {
-            next(p);
-            expect(p, TOK_LPAREN);
-            s = new_stmt(STMT_PRINT);
-            s->print = parse_expr(p);
-            expect(p, TOK_RPAREN);
-            expect(p, TOK_SEMI);
-        } else if (match(p, TOK_RETURN)) {
-            next(p);
-            s = new_stmt(STMT_RETURN);
-            s->ret = NULL;
-            if (!match(p, TOK_SEMI))
-                s->ret = parse_expr(p);
-            expect(p, TOK_SEMI);
-        } else {
-            die("line %d: statement expected", p->cur.line);
-        }
-        block_append(&b, s);
-    }
+    while (!match(p, TOK_RBRACE))
+        block_append(&b, parse_stmt(p));
     expect(p, TOK_RBRACE);
     return b;
 }
 
-// parse function definition
+// parse function definition with its @attributes
 // could validate duplicate names here
 static AST_FuncDecl parse_func(Parser *p) {
     AST_FuncDecl f = {0};
+    while (match(p, TOK_AT)) {
+        next(p);
+        if (!match(p, TOK_IDENT) || strcmp(p->cur.text.p, "memo"))
+            die("line %d: unknown attribute", p->cur.line);
+        f.memo = true;
+        next(p);
+    }
+    f.line = p->cur.line;
     expect(p, TOK_FUNC);
     f.name = strdup(p->cur.text.p);
     expect(p, TOK_IDENT);
+    if (is_builtin(f.name)) die("line %d: %s is a builtin", f.line, f.name);
 
     expect(p, TOK_LPAREN);
     if (!match(p, TOK_RPAREN)) {
@@ -308,6 +500,8 @@ AST_Program *parse(Lexer *l) {
     prog->funcs = NULL;
     prog->func_count = 0;
     prog->cap = 0;
+    prog->branches = NULL;
+    prog->branch_count = 0;
 
     while (!match(&p, TOK_EOF)) {
         if (prog->func_count == prog->cap) {
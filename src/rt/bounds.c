@@ -0,0 +1,10 @@
+#include "bounds.h"
+#include "out.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+void kilo_bounds_fail(int i, int len, int line) {
+    kilo_out_flush();
+    fprintf(stderr, "kilo: line %d: index %d out of bounds for length %d\n", line, i, len);
+    abort();
+}
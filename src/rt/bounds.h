@@ -0,0 +1,10 @@
+#pragma once
+
+// array bounds checks for generated code; range analysis removes the ones
+// it can prove, the rest cost a compare and a never-taken branch
+_Noreturn void kilo_bounds_fail(int i, int len, int line);
+
+static inline int kilo_idx(int i, int len, int line) {
+    if ((unsigned)i >= (unsigned)len) kilo_bounds_fail(i, len, line);  // also catches i < 0
+    return i;
+}
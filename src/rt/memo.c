@@ -0,0 +1,65 @@
+#include "memo.h"
+#include "out.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMO_MIN_CAP 64
+
+static uint32_t hash(const int *args, int n) {
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < n; ++i) {
+        h ^= (uint32_t)args[i];
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    return (uint32_t)h;
+}
+
+static int *slot(const KiloMemo *m, uint32_t i) {
+    return m->slots + (size_t)i * (m->nargs + 2);
+}
+
+static int *probe(const KiloMemo *m, const int *args) {
+    uint32_t mask = m->cap - 1;
+    for (uint32_t i = hash(args, m->nargs) & mask;; i = (i + 1) & mask) {
+        int *s = slot(m, i);
+        if (!s[0] || !memcmp(s + 2, args, m->nargs * sizeof *args)) return s;
+    }
+}
+
+static void resize(KiloMemo *m, uint32_t cap) {
+    KiloMemo old = *m;
+    m->slots = calloc((size_t)cap * (m->nargs + 2), sizeof *m->slots);
+    if (!m->slots) {
+        kilo_out_flush();
+        fprintf(stderr, "kilo: out of memory growing a memo table to %u entries\n", cap);
+        abort();
+    }
+    m->cap = cap;
+    m->count = 0;
+    for (uint32_t i = 0; i < old.cap; ++i) {
+        int *s = slot(&old, i);
+        if (s[0]) { memcpy(probe(m, s + 2), s, (m->nargs + 2) * sizeof *s); m->count++; }
+    }
+    free(old.slots);
+}
+
+int *kilo_memo_find(KiloMemo *m, const int *args) {
+    if (!m->cap) return NULL;
+    int *s = probe(m, args);
+    return s[0] ? &s[1] : NULL;
+}
+
+void kilo_memo_put(KiloMemo *m, const int *args, int result) {
+    if (m->count >= KILO_MEMO_MAX) {  // forget everything, keep the memory
+        memset(m->slots, 0, (size_t)m->cap * (m->nargs + 2) * sizeof *m->slots);
+        m->count = 0;
+    }
+    if (2 * (m->count + 1) > m->cap) resize(m, m->cap ? m->cap * 2 : MEMO_MIN_CAP);
+    int *s = probe(m, args);
+    if (!s[0]) m->count++;
+    s[0] = 1;
+    s[1] = result;
+    memcpy(s + 2, args, m->nargs * sizeof *args);
+}
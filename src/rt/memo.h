@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+// result cache for @memo functions: open addressing over int argument
+// tuples. generated code keeps one _Thread_local table per function, so
+// lookups take no lock; a table that reaches KILO_MEMO_MAX entries is
+// emptied rather than grown
+#define KILO_MEMO_MAX (1u << 20)
+
+typedef struct {
+    int nargs;
+    uint32_t cap, count;  // cap is a power of two, 0 until the first put
+    int *slots;           // cap slots of { used, result, args[nargs] }
+} KiloMemo;
+
+#define KILO_MEMO_INIT(nargs) { nargs, 0, 0, 0 }
+
+// cached result for args, or NULL; only valid until the next put
+int *kilo_memo_find(KiloMemo *m, const int *args);
+void kilo_memo_put(KiloMemo *m, const int *args, int result);
@@ -0,0 +1,146 @@
+#include "out.h"
+#include "../gc/gc.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    size_t used;
+    char bytes[KILO_OUT_BYTES];
+} OutBuf;
+
+static _Thread_local OutBuf *tl_buf;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t exit_key;  // runs thread_done when a thread exits
+static int line_mode;           // stdout is a terminal
+
+// drops output on a write error, like a full pipe would anyway
+static void write_all(const char *p, size_t n) {
+    while (n) {
+        ssize_t w = write(STDOUT_FILENO, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) break;
+        p += w; n -= (size_t)w;
+    }
+}
+
+static void drain(OutBuf *b) {
+    write_all(b->bytes, b->used);
+    b->used = 0;
+}
+
+// write blocks for as long as the reader wants, let the gc run meanwhile;
+// the buffer is malloc'd so the gc never needs to see it
+static void drain_native(OutBuf *b) {
+    gc_enter_native();
+    drain(b);
+    gc_leave_native();
+}
+
+static void thread_done(void *p) {
+    OutBuf *b = p;
+    drain(b);
+    free(b);
+}
+
+static void out_init(void) {
+    line_mode = isatty(STDOUT_FILENO);
+    pthread_key_create(&exit_key, thread_done);
+    // the main thread's key destructor never runs. only the exiting thread's
+    // buffer: the other threads still alive are pool workers, and each job
+    // flushes before it reports completion (see pool.c), so theirs hold
+    // output of a job still running (an unjoined task may be cut off) and
+    // aren't ours to touch
+    atexit(kilo_out_flush);
+}
+
+static OutBuf *buf(void) {
+    if (tl_buf) return tl_buf;
+    pthread_once(&once, out_init);
+    OutBuf *b = malloc(sizeof *b);
+    if (!b) abort();
+    b->used = 0;
+    pthread_setspecific(exit_key, b);
+    return tl_buf = b;
+}
+
+// room for n more bytes, draining first if they don't fit
+static OutBuf *reserve(size_t n) {
+    OutBuf *b = buf();
+    if (KILO_OUT_BYTES - b->used < n) drain_native(b);
+    return b;
+}
+
+static void end_line(OutBuf *b) {
+    b->bytes[b->used++] = '\n';
+    if (line_mode) drain_native(b);
+}
+
+// "00".."99", two digits per division
+static const char digits2[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+void kilo_println_int(int v) {
+    char tmp[12], *p = tmp + sizeof tmp;
+    unsigned u = v < 0 ? 0u - (unsigned)v : (unsigned)v;  // INT_MIN safe
+    while (u >= 100) {
+        unsigned r = u % 100;
+        u /= 100;
+        p -= 2; memcpy(p, digits2 + 2*r, 2);
+    }
+    if (u >= 10) { p -= 2; memcpy(p, digits2 + 2*u, 2); }
+    else *--p = (char)('0' + u);
+    if (v < 0) *--p = '-';
+
+    size_t n = (size_t)(tmp + sizeof tmp - p);
+    OutBuf *b = reserve(n + 1);
+    memcpy(b->bytes + b->used, p, n);
+    b->used += n;
+    end_line(b);
+}
+
+void kilo_println_bytes(const char *p, size_t n) {
+    OutBuf *b = reserve(n + 1);
+    if (n >= KILO_OUT_BYTES) {  // too big to buffer, reserve drained b already
+        gc_enter_native();      // p is rooted by our caller's frame
+        write_all(p, n);
+        gc_leave_native();
+        end_line(b);
+        return;
+    }
+    memcpy(b->bytes + b->used, p, n);
+    b->used += n;
+    end_line(b);
+}
+
+void kilo_println_double(double v) {
+    char tmp[32];
+    int n = snprintf(tmp, sizeof tmp, "%g", v);
+    kilo_println_bytes(tmp, (size_t)n);
+}
+
+// (a, b, c, d); lanes are at most 8 and each fits in 16 bytes
+void kilo_println_floats(const float *v, int n) {
+    char tmp[8 * 16 + 2], *p = tmp;
+    for (int i = 0; i < n; i++) p += sprintf(p, "%s%g", i ? ", " : "(", (double)v[i]);
+    *p++ = ')';
+    kilo_println_bytes(tmp, (size_t)(p - tmp));
+}
+
+void kilo_println_ints(const int *v, int n) {
+    char tmp[8 * 16 + 2], *p = tmp;
+    for (int i = 0; i < n; i++) p += sprintf(p, "%s%d", i ? ", " : "(", v[i]);
+    *p++ = ')';
+    kilo_println_bytes(tmp, (size_t)(p - tmp));
+}
+
+void kilo_out_flush(void) {
+    if (tl_buf) drain(tl_buf);
+}
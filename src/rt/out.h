@@ -0,0 +1,17 @@
+#pragma once
+#include <stddef.h>
+
+#define KILO_OUT_BYTES (64u << 10)  // per-thread stdout buffer
+
+// buffered stdout for print, one buffer per thread so printing takes no
+// lock; a buffer goes out with one write(2) when full, when its thread
+// exits, on kilo_out_flush, and at exit() if it is the exiting thread's.
+// lines are never split between writes, so threads interleave whole
+// lines. on a terminal every line is flushed as it is printed
+void kilo_println_int(int v);
+void kilo_println_bytes(const char *p, size_t n);
+void kilo_println_double(double v);              // %g, 6 significant digits
+void kilo_println_floats(const float *v, int n);  // vector lanes: (1, 2.5, 3, 4)
+void kilo_println_ints(const int *v, int n);
+// write out the calling thread's buffer; also called before fatal errors
+void kilo_out_flush(void);
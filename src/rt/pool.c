@@ -0,0 +1,240 @@
+#include "pool.h"
+#include "out.h"
+#include "../gc/gc.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define KILO_POOL_MAX 64
+
+typedef KiloJob Job;
+
+// jobs[top..bottom), owner end at the bottom; a mutex per deque keeps it
+// simple, a push or steal is a handful of instructions under it
+typedef struct {
+    pthread_mutex_t lock;
+    Job **jobs;
+    size_t top, bottom, cap;
+} Deque;
+
+static struct {
+    int nthreads;                   // workers + the thread that started them
+    Deque deques[KILO_POOL_MAX];    // 0: threads outside the pool, i: worker i
+    atomic_int queued;              // jobs in all deques
+    atomic_int sleepers;            // threads in idle, wakers skip the lock at 0
+    pthread_mutex_t lock;           // sleeping threads wait on cv under it
+    pthread_cond_t cv;              // new jobs, or a caller's jobs finished
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .cv = PTHREAD_COND_INITIALIZER };
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static _Thread_local int self;  // own deque
+
+static void oom(void) {
+    kilo_out_flush();
+    fprintf(stderr, "kilo: out of memory in the thread pool\n");
+    abort();
+}
+
+static void push(Deque *d, Job *j) {
+    if (d->bottom == d->cap) {
+        if (d->top) {  // slide down over the stolen slots
+            memmove(d->jobs, d->jobs + d->top, (d->bottom - d->top) * sizeof *d->jobs);
+            d->bottom -= d->top;
+            d->top = 0;
+        } else {
+            d->cap = d->cap ? d->cap * 2 : 64;
+            d->jobs = realloc(d->jobs, d->cap * sizeof *d->jobs);
+            if (!d->jobs) oom();
+        }
+    }
+    d->jobs[d->bottom++] = j;
+}
+
+static Job *pop(Deque *d, bool steal) {
+    Job *j = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->top < d->bottom) j = steal ? d->jobs[d->top++] : d->jobs[--d->bottom];
+    if (d->top == d->bottom) d->top = d->bottom = 0;
+    pthread_mutex_unlock(&d->lock);
+    return j;
+}
+
+// own deque newest first, then the oldest job of each other thread
+static Job *find_job(void) {
+    if (!atomic_load(&pool.queued)) return NULL;
+    Job *j = pop(&pool.deques[self], false);
+    for (int k = 1; !j && k < pool.nthreads; k++)
+        j = pop(&pool.deques[(self + k) % pool.nthreads], true);
+    if (j) atomic_fetch_sub(&pool.queued, 1);
+    return j;
+}
+
+// wakers publish their change before reading sleepers, sleepers count
+// themselves before testing for it, so one of the two always sees the other
+static void wake(bool all) {
+    if (!atomic_load(&pool.sleepers)) return;
+    pthread_mutex_lock(&pool.lock);
+    if (all) pthread_cond_broadcast(&pool.cv);
+    else pthread_cond_signal(&pool.cv);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static void wake_all(void) { wake(true); }
+
+// sleep until there is work, or until *pending drops to 0; the gc can
+// collect meanwhile
+static void idle(atomic_int *pending) {
+    gc_enter_native();
+    pthread_mutex_lock(&pool.lock);
+    atomic_fetch_add(&pool.sleepers, 1);
+    while (!atomic_load(&pool.queued) && !(pending && !atomic_load(pending)))
+        pthread_cond_wait(&pool.cv, &pool.lock);
+    atomic_fetch_sub(&pool.sleepers, 1);
+    pthread_mutex_unlock(&pool.lock);
+    gc_leave_native();
+}
+
+// queued tasks are reachable only through the deques, which live in malloc
+// memory; the world is stopped, so no deque is mid-update
+static void scan_deques(void) {
+    for (int i = 0; i < pool.nthreads; i++) {
+        Deque *d = &pool.deques[i];
+        if (d->jobs) gc_mark_roots((void *const *)d->jobs + d->top, (void *const *)d->jobs + d->bottom);
+    }
+}
+
+static void *worker(void *arg) {
+    GC_REGISTER_THREAD();
+    self = (int)(intptr_t)arg;
+    for (;;) {
+        Job *j = find_job();
+        if (!j) { idle(NULL); continue; }
+        j->run(j);
+        gc_safepoint();
+    }
+    return NULL;
+}
+
+static void pool_init(void) {
+    const char *s = getenv("KILO_THREADS");
+    long n = s ? atol(s) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    if (n > KILO_POOL_MAX) n = KILO_POOL_MAX;
+    pool.nthreads = (int)n;
+    for (int i = 0; i < n; i++) pthread_mutex_init(&pool.deques[i].lock, NULL);
+    gc_add_roots(scan_deques);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 1; i < n; i++) {
+        pthread_t t;
+        if (pthread_create(&t, &attr, worker, (void *)(intptr_t)i))
+            break;  // run with fewer, waiting callers do whatever is left
+    }
+    pthread_attr_destroy(&attr);
+}
+
+/* ------------------------------------------------------------------ */
+/* parallel for */
+
+typedef struct {
+    Job job;
+    KiloParBody body;
+    void *env;
+    int lo, hi, chunk;
+    atomic_int *pending;
+} ParJob;
+
+static void par_run(Job *j) {
+    ParJob *p = (ParJob *)j;
+    p->body(p->env, p->lo, p->hi, p->chunk);
+    kilo_out_flush();  // the chunk's output goes out before the loop can return
+    if (atomic_fetch_sub(p->pending, 1) == 1) wake_all();  // p may be gone after this
+}
+
+int kilo_par_for(int lo, int hi, KiloParBody body, void *env) {
+    if (hi <= lo) return 0;
+    pthread_once(&once, pool_init);
+    long n = (long)hi - lo;
+    long chunks = (long)pool.nthreads * KILO_PAR_CHUNKS_PER_THREAD;
+    if (chunks > KILO_PAR_MAX_CHUNKS) chunks = KILO_PAR_MAX_CHUNKS;
+    if (chunks > n) chunks = n;
+    if (pool.nthreads == 1 || chunks == 1) {
+        body(env, lo, hi, 0);
+        return 1;
+    }
+
+    ParJob *jobs = malloc(chunks * sizeof *jobs);
+    if (!jobs) oom();
+    atomic_int pending = (int)chunks;
+    kilo_out_flush();  // earlier output stays ahead of the loop's
+    Deque *d = &pool.deques[self];
+    pthread_mutex_lock(&d->lock);
+    for (long c = chunks - 1; c >= 0; c--) {  // chunk 0 on the bottom, thieves take the far end
+        jobs[c] = (ParJob){ { par_run }, body, env, (int)(lo + n * c / chunks),
+                            (int)(lo + n * (c + 1) / chunks), (int)c, &pending };
+        push(d, &jobs[c].job);
+    }
+    pthread_mutex_unlock(&d->lock);
+    atomic_fetch_add(&pool.queued, (int)chunks);
+    wake_all();
+
+    while (atomic_load(&pending)) {
+        Job *j = find_job();
+        if (j) j->run(j);
+        else idle(&pending);
+    }
+    free(jobs);
+    return (int)chunks;
+}
+
+/* ------------------------------------------------------------------ */
+/* tasks */
+
+static void task_run(Job *j) {
+    KiloTask *t = (KiloTask *)j;
+    t->body(t);
+    kilo_out_flush();  // the task's output goes out before a joiner's later lines
+    atomic_store(&t->pending, 0);
+    wake_all();  // a joiner may be asleep on it
+}
+
+void *kilo_task_new(size_t size, void (*body)(KiloTask *)) {
+    KiloTask *t = gc_alloc_traced(size);
+    memset(t, 0, sizeof *t);
+    t->job.run = task_run;
+    t->body = body;
+    atomic_init(&t->pending, 1);
+    return t;
+}
+
+KiloTask *kilo_task_start(KiloTask *t) {
+    pthread_once(&once, pool_init);
+    if (pool.nthreads > 1) kilo_out_flush();  // earlier output stays ahead of the task's
+    Deque *d = &pool.deques[self];
+    pthread_mutex_lock(&d->lock);
+    push(d, &t->job);
+    pthread_mutex_unlock(&d->lock);
+    atomic_fetch_add(&pool.queued, 1);
+    wake(false);
+    return t;
+}
+
+KiloTask *kilo_join(KiloTask *t, int line) {
+    if (!t) {
+        kilo_out_flush();
+        fprintf(stderr, "kilo: line %d: join of a task that was never spawned\n", line);
+        abort();
+    }
+    while (atomic_load(&t->pending)) {  // usually t is the newest job here and runs inline
+        Job *j = find_job();
+        if (j) j->run(j);
+        else idle(&t->pending);
+    }
+    return t;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdatomic.h>
+#include <stddef.h>
+#include "../gc/kstr.h"
+
+// work-stealing thread pool behind parallel for and spawn. each thread owns a deque
+// of jobs: it pushes and pops at the bottom, idle threads steal from the
+// top of the others'. a thread waiting for its jobs runs queued ones in the
+// meantime, so nested parallel loops can't deadlock the pool.
+// $KILO_THREADS sets the thread count including the caller (default: online
+// cpus); workers start on first use and are registered with the gc
+#define KILO_PAR_MAX_CHUNKS 256
+#define KILO_PAR_CHUNKS_PER_THREAD 4  // slack for uneven iterations
+
+// runs iterations [lo, hi) of a parallel for as chunk number chunk
+typedef void (*KiloParBody)(void *env, int lo, int hi, int chunk);
+
+// split [lo, hi) into up to KILO_PAR_MAX_CHUNKS contiguous chunks numbered
+// from lo upwards, run them across the pool and return the chunk count once
+// all are done; a single thread just calls body once
+int kilo_par_for(int lo, int hi, KiloParBody body, void *env);
+
+// anything a deque holds: parallel for chunks and tasks start with one
+typedef struct KiloJob {
+    void (*run)(struct KiloJob *);
+} KiloJob;
+
+// spawn f(args): a gc record holding this header, then the arguments; it is
+// traced, so strings among the arguments and in ret stay alive while the
+// task is queued or its handle is live. tasks are stackless and run to
+// completion on whichever thread picks them up; the only place a task
+// waits is join, and a joining thread runs other queued jobs meanwhile, so
+// an idle task costs its record and a deque slot, not a stack
+typedef struct KiloTask {
+    KiloJob job;
+    void (*body)(struct KiloTask *);   // reads the arguments, sets ret
+    atomic_int pending;                // 1 until ret is set
+    union { int i; float f; double d; kstr s; } ret;
+} KiloTask;
+
+// record of size bytes with the header filled in, arguments up to the caller
+void *kilo_task_new(size_t size, void (*body)(KiloTask *));
+// queue t on the calling thread's deque, returns t
+KiloTask *kilo_task_start(KiloTask *t);
+// wait for t, running queued jobs meanwhile, returns t; t NULL (never
+// spawned) is a runtime error at line
+KiloTask *kilo_join(KiloTask *t, int line);
@@ -0,0 +1,32 @@
+#include "prof.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static struct {
+    int nfuncs, nbranches;
+    const char *const *funcs;
+    const uint64_t *calls;
+    const KiloProfBranch *branches;
+    uint64_t (*counts)[2];
+} P;
+
+static void prof_write(void) {
+    const char *path = getenv("KILO_PROFILE");
+    if (!path || !*path) path = "kilo.prof";
+    FILE *f = fopen(path, "w");
+    if (!f) { fprintf(stderr, "kilo: cannot write profile %s\n", path); return; }
+    for (int i = 0; i < P.nfuncs; ++i)
+        fprintf(f, "func %s %llu\n", P.funcs[i], (unsigned long long)P.calls[i]);
+    for (int i = 1; i < P.nbranches; ++i)  // entry 0 is unused
+        fprintf(f, "branch %s %d %d %llu %llu\n", P.branches[i].func, P.branches[i].ordinal,
+                P.branches[i].line, (unsigned long long)P.counts[i][1],
+                (unsigned long long)P.counts[i][0]);
+    fclose(f);
+}
+
+void kilo_prof_init(int nfuncs, const char *const *funcs, const uint64_t *calls,
+                    int nbranches, const KiloProfBranch *branches, uint64_t (*counts)[2]) {
+    P.nfuncs = nfuncs; P.funcs = funcs; P.calls = calls;
+    P.nbranches = nbranches; P.branches = branches; P.counts = counts;
+    atexit(prof_write);
+}
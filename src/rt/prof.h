@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+// counters for kiloc --profile-gen. generated code owns the arrays and
+// registers them once; at exit they are written as text to $KILO_PROFILE
+// (default kilo.prof) for kiloc --profile-use:
+//     func <name> <calls>
+//     branch <func> <ordinal> <line> <true> <false>
+// counts are plain increments, threads may lose a few
+
+typedef struct { const char *func; int ordinal, line; } KiloProfBranch;
+
+void kilo_prof_init(int nfuncs, const char *const *funcs, const uint64_t *calls,
+                    int nbranches, const KiloProfBranch *branches, uint64_t (*counts)[2]);
+
+// count one evaluation of a branch condition, pass its value through
+static inline int kilo_prof_br(uint64_t *count, int cond) {
+    count[cond != 0]++;
+    return cond;
+}
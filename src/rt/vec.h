@@ -0,0 +1,45 @@
+#pragma once
+#include "out.h"
+
+// float4, int4 and float8 are gcc/clang vector extension types, so + - * /
+// on them (and with a scalar, broadcast to every lane) compile straight to
+// sse/avx instructions; float8 is one avx register, or two sse ones when the
+// c compiler isn't told -mavx. v[i] reads or writes a lane. programs using
+// them need gcc or clang, others still build anywhere
+#ifdef __GNUC__
+#if !defined(__clang__)
+// every function taking a vector is static, the abi warnings are noise;
+// gcc still prints a note for float8 parameters unless given -Wno-psabi or -mavx
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+typedef float KiloFloat4 __attribute__((vector_size(16)));
+typedef int   KiloInt4   __attribute__((vector_size(16)));
+typedef float KiloFloat8 __attribute__((vector_size(32)));
+
+// hsum/hmin/hmax fold the lanes pairwise, a straight-line tree of
+// log2(lanes) levels the compiler can keep in registers
+#define KILO_FOLD_AT(v, op, o) op(op(v[o], v[o + 2]), op(v[o + 1], v[o + 3]))
+#define KILO_FOLD4(v, op) KILO_FOLD_AT(v, op, 0)
+#define KILO_FOLD8(v, op) op(KILO_FOLD_AT(v, op, 0), KILO_FOLD_AT(v, op, 4))
+#define KILO_VEC_FOLD(name, V, E, N, op) \
+    static inline E kilo_##name(V v) { return KILO_FOLD##N(v, op); }
+
+#define KILO_ADD(a, b) ((a) + (b))
+#define KILO_MIN(a, b) ((b) < (a) ? (b) : (a))
+#define KILO_MAX(a, b) ((b) > (a) ? (b) : (a))
+
+#define KILO_VEC_OPS(T, V, E, N, print)                                    \
+    KILO_VEC_FOLD(hsum_##T, V, E, N, KILO_ADD)                             \
+    KILO_VEC_FOLD(hmin_##T, V, E, N, KILO_MIN)                             \
+    KILO_VEC_FOLD(hmax_##T, V, E, N, KILO_MAX)                             \
+    static inline void kilo_println_##T(V v) {                             \
+        E lanes[N];                                                        \
+        for (int i = 0; i < N; i++) lanes[i] = v[i];                       \
+        print(lanes, N);                                                   \
+    }
+
+KILO_VEC_OPS(float4, KiloFloat4, float, 4, kilo_println_floats)
+KILO_VEC_OPS(int4, KiloInt4, int, 4, kilo_println_ints)
+KILO_VEC_OPS(float8, KiloFloat8, float, 8, kilo_println_floats)
+#endif
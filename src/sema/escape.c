@@ -0,0 +1,185 @@
+#include "sema.h"
+#include "../utils/die.h"
+#include <string.h>
+#include <stdlib.h>
+
+// escape analysis for string values, two flags per variable/param:
+// escapes:  may be read after its frame is gone or after the expression that
+//           produced it runs again: returned, copied into another variable,
+//           or passed to a parameter that escapes. print, concat operands and
+//           comparisons only read it in place. decides stack buffers
+// outlives: may be read after its function returns: returned, or flows into
+//           a variable or parameter that outlives. decides whether a manual
+//           value stays inside its function's region
+// both are solved to a fixed point over the call graph, then allocating
+// expressions get no_escape / in_region from their consumer. parallel for
+// bodies run as separate c functions on other threads, so they never get
+// stack buffers; spawn arguments live on in the task, which may outlive the
+// function that spawned it
+
+typedef struct { const char *name; bool *escapes, *outlives; bool manual; } Binding;
+
+static struct {
+    AST_Program *prog;
+    Binding *vars;      // scope stack, innermost last
+    int count, cap;
+    bool changed;       // a flag flipped this round, iterate again
+    bool final;         // flags are stable, fill in expr flags and diagnose
+    int par;            // inside this many parallel for bodies
+} E;
+
+static void bind(const char *name, bool *escapes, bool *outlives, bool manual) {
+    if (E.count == E.cap) {
+        E.cap = E.cap ? E.cap*2 : 16;
+        E.vars = realloc(E.vars, E.cap * sizeof *E.vars);
+    }
+    E.vars[E.count++] = (Binding){ name, escapes, outlives, manual };
+}
+
+static Binding *lookup(const char *name) {
+    for (int i=E.count-1;i>=0;i--) if (!strcmp(E.vars[i].name, name)) return &E.vars[i];
+    return NULL;
+}
+
+static AST_FuncDecl *callee(const char *name) {
+    for (int i=0;i<E.prog->func_count;i++)
+        if (!strcmp(E.prog->funcs[i].name, name)) return &E.prog->funcs[i];
+    return NULL;
+}
+
+static void set(bool *flag) {
+    if (flag && !*flag) { *flag = true; E.changed = true; }
+}
+
+// the value of e reaches a use that keeps it; only variables carry values,
+// an array element is tracked as its whole array
+static void mark(AST_Expr *e, bool outlives) {
+    if (!e || e->ty != TYPE_STRING) return;
+    if (e->kind != EXPR_IDENT && e->kind != EXPR_INDEX) return;
+    Binding *b = lookup(e->kind == EXPR_IDENT ? e->ident : e->index.name);
+    if (!b) return;
+    set(b->escapes);
+    if (outlives) set(b->outlives);
+}
+
+// does e read variable name (the result would overwrite its own input)
+static bool mentions(AST_Expr *e, const char *name) {
+    switch (e->kind) {
+    case EXPR_IDENT: return !strcmp(e->ident, name);
+    case EXPR_INDEX: return !strcmp(e->index.name, name) || mentions(e->index.at, name);
+    case EXPR_BIN: return mentions(e->bin.left, name) || mentions(e->bin.right, name);
+    case EXPR_CMP: return mentions(e->cmp.left, name) || mentions(e->cmp.right, name);
+    case EXPR_CALL: case EXPR_SPAWN: case EXPR_BUILTIN:
+        for (int i=0;i<e->call.arg_count;i++) if (mentions(e->call.args[i], name)) return true;
+        return false;
+    case EXPR_JOIN: return mentions(e->join, name);
+    default: return false;
+    }
+}
+
+// no_escape: the consumer of e's value only reads it before the frame ends
+static void walk_expr(AST_Expr *e, bool no_escape) {
+    if (E.final) e->no_escape = no_escape && !E.par;
+    switch (e->kind) {
+    case EXPR_BIN: walk_expr(e->bin.left, true); walk_expr(e->bin.right, true); break;
+    case EXPR_CMP: walk_expr(e->cmp.left, true); walk_expr(e->cmp.right, true); break;
+    case EXPR_INDEX: walk_expr(e->index.at, true); break;
+    case EXPR_CALL: {
+        AST_FuncDecl *f = callee(e->call.name);
+        for (int i=0;i<e->call.arg_count;i++) {
+            bool known = f && i < f->param_count;
+            bool esc = !known || f->params[i].escapes;
+            walk_expr(e->call.args[i], !esc);
+            if (esc) mark(e->call.args[i], !known || f->params[i].outlives);
+        }
+        break;
+    }
+    case EXPR_SPAWN:
+        for (int i=0;i<e->call.arg_count;i++) {
+            walk_expr(e->call.args[i], false);
+            mark(e->call.args[i], true);
+        }
+        break;
+    case EXPR_JOIN: walk_expr(e->join, true); break;
+    case EXPR_BUILTIN:
+        for (int i=0;i<e->call.arg_count;i++) walk_expr(e->call.args[i], true);
+        break;
+    default: break;
+    }
+}
+
+// value of e is stored into variable name
+static void walk_store(AST_Expr *e, const char *name) {
+    Binding *b = lookup(name);
+    walk_expr(e, b && !*b->escapes && !mentions(e, name));
+    if (E.final) e->in_region = b && b->manual;
+    if (e->kind != EXPR_IDENT || strcmp(e->ident, name))  // copy = escape
+        mark(e, !b || *b->outlives);
+}
+
+static void walk_block(AST_Block b) {
+    int scope = E.count;
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        switch (s->kind) {
+        case STMT_VAR:
+            bind(s->var.name, &s->var.escapes, &s->var.outlives, s->var.manual);
+            if (s->var.init) walk_store(s->var.init, s->var.name);
+            if (E.final && s->var.manual && s->var.outlives)
+                die("line %d: manual var %s escapes its region", s->line, s->var.name);
+            break;
+        case STMT_ASSIGN: {
+            if (!s->assign.index) { walk_store(s->assign.expr, s->assign.name); break; }
+            // an element outlives the statement that stored it, so never a
+            // reused stack buffer, and it shares the array's fate
+            Binding *b = lookup(s->assign.name);
+            walk_expr(s->assign.index, true);
+            walk_expr(s->assign.expr, false);
+            mark(s->assign.expr, !b || *b->outlives);
+            break;
+        }
+        case STMT_IF:
+            walk_expr(s->if_.cond, true);
+            walk_block(s->if_.then);
+            walk_block(s->if_.else_);
+            break;
+        case STMT_WHILE:
+            walk_expr(s->while_.cond, true);
+            walk_block(s->while_.body);
+            break;
+        case STMT_PFOR:
+            walk_expr(s->pfor.lo, true);
+            walk_expr(s->pfor.hi, true);
+            E.par++;
+            walk_block(s->pfor.body);
+            E.par--;
+            break;
+        case STMT_PRINT: walk_expr(s->print, true); break;
+        case STMT_RETURN:
+            if (s->ret) { walk_expr(s->ret, false); mark(s->ret, true); }
+            break;
+        case STMT_FREE: break;
+        case STMT_EXPR: walk_expr(s->expr, true); break;
+        }
+    }
+    E.count = scope;
+}
+
+static void walk_func(AST_FuncDecl *f) {
+    E.count = 0;
+    for (int i=0;i<f->param_count;i++)
+        bind(f->params[i].name, &f->params[i].escapes, &f->params[i].outlives, false);
+    walk_block(f->body);
+}
+
+// flags only ever go false -> true, so the loop terminates
+void escape_analyze(AST_Program *p) {
+    E.prog = p;
+    E.final = false;
+    do {
+        E.changed = false;
+        for (int i=0;i<p->func_count;i++) walk_func(&p->funcs[i]);
+    } while (E.changed);
+    E.final = true;
+    for (int i=0;i<p->func_count;i++) walk_func(&p->funcs[i]);
+}
@@ -0,0 +1,259 @@
+#include "sema.h"
+#include "../lexer/lexer.h"  // operator token kinds
+#include "../utils/die.h"
+#include <string.h>
+#include <stdlib.h>
+
+// dependence check for parallel for. iterations run in any order on any
+// thread, so the body may only share state with other iterations through
+//   - outer variables it reads and never writes (each chunk gets a copy)
+//   - outer arrays written only at [i], the loop variable; an array that is
+//     written may not be read at any other index
+//   - int reductions, the only statements allowed to write an outer scalar:
+//         acc = acc + e;  acc = acc * e;          (or e + acc, e * acc)
+//         if (e < acc) { acc = e; }               min (also acc > e, <=, >=)
+//         if (e > acc) { acc = e; }               max
+//     with e not reading acc, and acc read nowhere else in the body. each
+//     chunk starts from the identity, codegen combines the partial results
+// locals declared in the body are private to an iteration. return, free and
+// manual variables are rejected: a task can't leave its function, and the
+// function's region isn't thread-safe. so is join of a task spawned outside
+// the loop: a thread running that task can pick up a chunk while it waits
+// in a join of its own, and the chunk would wait on the task beneath it
+
+typedef struct {
+    AST_Capture c;
+    int read_line;     // read outside a reduction, 0 = never
+    int stray_line;    // array accessed at an index other than the loop var
+    bool written;      // array element written
+} Use;
+
+static struct {
+    const char *var;                  // loop variable
+    const char **inner; int n, cap;   // declared in the body so far, scope stack
+    Use *uses; int count, cap_uses;
+} P;
+
+static bool is_var(AST_Expr *e, const char *name) {
+    return e->kind == EXPR_IDENT && !strcmp(e->ident, name);
+}
+
+static bool is_inner(const char *name) {
+    for (int i=0;i<P.n;i++) if (!strcmp(P.inner[i], name)) return true;
+    return false;
+}
+
+static void declare(const char *name) {
+    if (P.n == P.cap) {
+        P.cap = P.cap ? P.cap*2 : 16;
+        P.inner = realloc(P.inner, P.cap * sizeof *P.inner);
+    }
+    P.inner[P.n++] = name;
+}
+
+// the capture for outer variable name, NULL for loop-private names
+static Use *use(const char *name, Type ty, int len) {
+    if (is_inner(name)) return NULL;
+    for (int i=0;i<P.count;i++) if (!strcmp(P.uses[i].c.name, name)) return &P.uses[i];
+    if (P.count == P.cap_uses) {
+        P.cap_uses = P.cap_uses ? P.cap_uses*2 : 8;
+        P.uses = realloc(P.uses, P.cap_uses * sizeof *P.uses);
+    }
+    P.uses[P.count] = (Use){ .c = { name, ty, len, REDUCE_NONE } };
+    return &P.uses[P.count++];
+}
+
+// the vector a lane access reads
+static Type lane_vector(AST_Expr *e) {
+    return e->ty == TYPE_INT ? TYPE_INT4 : e->index.len == 8 ? TYPE_FLOAT8 : TYPE_FLOAT4;
+}
+
+static void read_one(AST_Expr *e, void *ctx) {
+    (void)ctx;
+    Use *u;
+    if (e->kind == EXPR_JOIN) {
+        const char *t = e->join->kind == EXPR_IDENT ? e->join->ident : e->join->index.name;
+        if (!is_inner(t)) die("line %d: parallel for joins outer task %s", e->line, t);
+    }
+    if (e->kind == EXPR_IDENT && (u = use(e->ident, e->ty, 0)) && !u->read_line)
+        u->read_line = e->line;
+    if (e->kind == EXPR_INDEX && e->index.lane) {  // v[k] reads all of v, a scalar
+        if ((u = use(e->index.name, lane_vector(e), 0)) && !u->read_line) u->read_line = e->line;
+        return;
+    }
+    if (e->kind == EXPR_INDEX && (u = use(e->index.name, e->ty, e->index.len)) &&
+        !is_var(e->index.at, P.var) && !u->stray_line)
+        u->stray_line = e->line;
+}
+
+static void reads(AST_Expr *e) {
+    ast_visit_expr(e, read_one, NULL);
+}
+
+// does e read variable name
+static bool mentions(AST_Expr *e, const char *name) {
+    switch (e->kind) {
+    case EXPR_IDENT: return !strcmp(e->ident, name);
+    case EXPR_INDEX: return (e->index.lane && !strcmp(e->index.name, name)) || mentions(e->index.at, name);
+    case EXPR_BIN: return mentions(e->bin.left, name) || mentions(e->bin.right, name);
+    case EXPR_CMP: return mentions(e->cmp.left, name) || mentions(e->cmp.right, name);
+    case EXPR_CALL: case EXPR_SPAWN: case EXPR_BUILTIN:
+        for (int i=0;i<e->call.arg_count;i++) if (mentions(e->call.args[i], name)) return true;
+        return false;
+    case EXPR_JOIN: return mentions(e->join, name);
+    default: return false;
+    }
+}
+
+static bool same(AST_Expr *a, AST_Expr *b) {
+    if (a->kind != b->kind) return false;
+    switch (a->kind) {
+    case EXPR_INT: return a->int_lit == b->int_lit;
+    case EXPR_FLOAT: return a->float_lit == b->float_lit;
+    case EXPR_STR: return !strcmp(a->str_lit, b->str_lit);
+    case EXPR_IDENT: return !strcmp(a->ident, b->ident);
+    case EXPR_INDEX: return !strcmp(a->index.name, b->index.name) && same(a->index.at, b->index.at);
+    case EXPR_BIN:
+        return a->bin.op == b->bin.op && same(a->bin.left, b->bin.left) && same(a->bin.right, b->bin.right);
+    case EXPR_CMP:
+        return a->cmp.cmp == b->cmp.cmp && same(a->cmp.left, b->cmp.left) && same(a->cmp.right, b->cmp.right);
+    case EXPR_CALL: case EXPR_SPAWN: case EXPR_BUILTIN:
+        if (strcmp(a->call.name, b->call.name) || a->call.arg_count != b->call.arg_count) return false;
+        for (int i=0;i<a->call.arg_count;i++) if (!same(a->call.args[i], b->call.args[i])) return false;
+        return true;
+    case EXPR_JOIN: return same(a->join, b->join);
+    }
+    return false;
+}
+
+static void reduce(Use *u, Reduce op, int line) {
+    if (u->c.type != TYPE_INT) die("line %d: parallel for can only reduce int, not %s", line, u->c.name);
+    if (u->c.reduce && u->c.reduce != op)
+        die("line %d: parallel for reduces %s with different operators", line, u->c.name);
+    u->c.reduce = op;
+}
+
+// acc = acc + e / acc = acc * e, false if s is some other store
+static bool arith_reduction(AST_Stmt *s) {
+    const char *acc = s->assign.name;
+    AST_Expr *e = s->assign.expr;
+    if (e->kind != EXPR_BIN || (e->bin.op != TOK_PLUS && e->bin.op != TOK_STAR)) return false;
+    AST_Expr *rest = is_var(e->bin.left, acc) ? e->bin.right :
+                     is_var(e->bin.right, acc) ? e->bin.left : NULL;
+    if (!rest || mentions(rest, acc)) return false;
+    reduce(use(acc, e->ty, 0), e->bin.op == TOK_PLUS ? REDUCE_ADD : REDUCE_MUL, s->line);
+    reads(rest);
+    return true;
+}
+
+// if (e < acc) { acc = e; } and its mirrored forms, acc an outer variable
+static bool minmax_reduction(AST_Stmt *s) {
+    AST_Expr *c = s->if_.cond;
+    if (s->if_.else_.count || s->if_.then.count != 1 || c->kind != EXPR_CMP) return false;
+    AST_Stmt *st = s->if_.then.stmts[0];
+    if (st->kind != STMT_ASSIGN || st->assign.index || is_inner(st->assign.name)) return false;
+    const char *acc = st->assign.name;
+    bool less = c->cmp.cmp == TOK_LT || c->cmp.cmp == TOK_LE;
+    if (!less && c->cmp.cmp != TOK_GT && c->cmp.cmp != TOK_GE) return false;
+    AST_Expr *e;
+    if (is_var(c->cmp.right, acc)) e = c->cmp.left;        // e < acc: min
+    else if (is_var(c->cmp.left, acc)) { e = c->cmp.right; less = !less; }  // acc > e: min
+    else return false;
+    if (!same(e, st->assign.expr) || mentions(e, acc)) return false;
+    reduce(use(acc, e->ty, 0), less ? REDUCE_MIN : REDUCE_MAX, s->line);
+    reads(e);
+    return true;
+}
+
+static void walk(AST_Block b) {
+    int scope = P.n;
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        switch (s->kind) {
+        case STMT_VAR:
+            if (s->var.manual) die("line %d: manual var %s in parallel for", s->line, s->var.name);
+            if (s->var.init) reads(s->var.init);
+            declare(s->var.name);
+            break;
+        case STMT_ASSIGN:
+            if (!strcmp(s->assign.name, P.var))
+                die("line %d: parallel for variable %s is assigned", s->line, P.var);
+            if (s->assign.index && s->assign.index->index.lane) {  // v[k] = e stores to v
+                reads(s->assign.index->index.at);
+                reads(s->assign.expr);
+                if (!is_inner(s->assign.name))
+                    die("line %d: parallel for writes %s, which other iterations see", s->line, s->assign.name);
+            } else if (s->assign.index) {
+                AST_Expr *ix = s->assign.index;
+                reads(ix->index.at);
+                reads(s->assign.expr);
+                Use *u = use(ix->index.name, ix->ty, ix->index.len);
+                if (u) {
+                    u->written = true;
+                    if (!is_var(ix->index.at, P.var) && !u->stray_line) u->stray_line = s->line;
+                }
+            } else if (is_inner(s->assign.name)) {
+                reads(s->assign.expr);
+            } else if (!arith_reduction(s)) {
+                die("line %d: parallel for writes %s, which other iterations see", s->line, s->assign.name);
+            }
+            break;
+        case STMT_IF:
+            if (minmax_reduction(s)) break;
+            reads(s->if_.cond);
+            walk(s->if_.then);
+            walk(s->if_.else_);
+            break;
+        case STMT_WHILE:
+            reads(s->while_.cond);
+            walk(s->while_.body);
+            break;
+        case STMT_PFOR:  // nested: checked on its own too, here it's just more body
+            reads(s->pfor.lo);
+            reads(s->pfor.hi);
+            declare(s->pfor.var);
+            walk(s->pfor.body);
+            P.n--;
+            break;
+        case STMT_PRINT: reads(s->print); break;
+        case STMT_EXPR: reads(s->expr); break;
+        case STMT_RETURN: die("line %d: return in parallel for", s->line); break;
+        case STMT_FREE: die("line %d: free in parallel for", s->line); break;
+        }
+    }
+    P.n = scope;
+}
+
+static void check(AST_Stmt *s) {
+    P.var = s->pfor.var;
+    P.n = P.count = 0;
+    declare(P.var);
+    walk(s->pfor.body);
+    s->pfor.caps = malloc((P.count ? P.count : 1) * sizeof *s->pfor.caps);
+    s->pfor.cap_count = P.count;
+    for (int i=0;i<P.count;i++) {
+        Use *u = &P.uses[i];
+        if (u->c.reduce && u->read_line)
+            die("line %d: parallel for reads reduction variable %s", u->read_line, u->c.name);
+        if (u->written && u->stray_line)
+            die("line %d: parallel for writes %s[%s] but uses it at another index",
+                u->stray_line, u->c.name, P.var);
+        s->pfor.caps[i] = u->c;
+    }
+}
+
+static void check_block(AST_Block b) {
+    for (int i=0;i<b.count;i++) {
+        AST_Stmt *s = b.stmts[i];
+        switch (s->kind) {
+        case STMT_IF: check_block(s->if_.then); check_block(s->if_.else_); break;
+        case STMT_WHILE: check_block(s->while_.body); break;
+        case STMT_PFOR: check(s); check_block(s->pfor.body); break;
+        default: break;
+        }
+    }
+}
+
+void parallel_check(AST_Program *p) {
+    for (int i=0;i<p->func_count;i++) check_block(p->funcs[i].body);
+}
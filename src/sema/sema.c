@@ -1,4 +1,5 @@
 #include "sema.h"
+#include "../lexer/lexer.h"  // operator token kinds
 #include "../utils/die.h"
 #include <string.h>
 #include <stdlib.h>
@@ -11,8 +12,10 @@ typedef struct {
     const char **locals;
     Type *local_ty;
     bool *local_manual;
+    bool *local_task;   // task handle, local_ty is the result type
+    int *local_len;     // array length, 0 for scalars
     int local_count;
-} Sema;
+} Sema; // locals form a scope stack, blocks pop what they declared
 
 static Sema g;  // global sema context, should reset before reuse
 
@@ -30,62 +33,198 @@ static int find_local(const char *name) {
     return -1;
 }
 
-// infer type of expression
-// doesn't handle type coercion or overloads
+// push a local into the current scope
+static void add_local(const char *name, Type ty, bool manual, bool task, int len) {
+    if (find_local(name)!=-1) die("redef var %s", name);
+    int i = g.local_count++;
+    g.locals = realloc(g.locals, g.local_count*sizeof(char*));       // no null check
+    g.local_ty = realloc(g.local_ty, g.local_count*sizeof(Type));
+    g.local_manual = realloc(g.local_manual, g.local_count*sizeof(bool));
+    g.local_task = realloc(g.local_task, g.local_count*sizeof(bool));
+    g.local_len = realloc(g.local_len, g.local_count*sizeof(int));
+    g.locals[i] = name;
+    g.local_ty[i] = ty;
+    g.local_manual[i] = manual;
+    g.local_task[i] = task;
+    g.local_len[i] = len;
+}
+
+static Type expr_type_(AST_Expr *e);
+
+// infer type of expression and record it on the node for later passes
 static Type expr_type(AST_Expr *e) {
+    return e->ty = expr_type_(e);
+}
+
+static bool is_float(Type t) { return t == TYPE_FLOAT || t == TYPE_DOUBLE; }
+static bool is_num(Type t) { return t == TYPE_INT || is_float(t); }
+
+// literals have no fixed width: 2 can be a float or double, 1.5 a float.
+// retypes typed literal e to want if that's all it takes, nothing else converts
+static bool fits(AST_Expr *e, Type want) {
+    if (e->ty == want) return true;
+    if (e->kind == EXPR_INT && is_float(want)) {
+        e->float_lit = e->int_lit;
+        e->kind = EXPR_FLOAT;
+    } else if (e->kind != EXPR_FLOAT || want != TYPE_FLOAT) {
+        return false;
+    }
+    e->ty = want;
+    return true;
+}
+
+// type of l op r: same numeric or vector types, or a vector and a scalar of
+// its lane type, which is broadcast to every lane
+static Type arith_type(AST_Expr *l, AST_Expr *r) {
+    if (type_lanes(l->ty) && fits(r, type_elem(l->ty))) return l->ty;
+    if (type_lanes(r->ty) && fits(l, type_elem(r->ty))) return r->ty;
+    if ((fits(l, r->ty) || fits(r, l->ty)) && (is_num(l->ty) || type_lanes(l->ty))) return l->ty;
+    return TYPE_VOID;
+}
+
+// T(x) converts between int, float and double, or between vectors of the
+// same width; a vector T takes one lane value to splat or one per lane
+static Type builtin_conv(AST_Expr *e, Type to) {
+    int n = e->call.arg_count;
+    AST_Expr **a = e->call.args;
+    for (int i=0;i<n;i++) expr_type(a[i]);
+    if (is_num(to)) {
+        if (n != 1 || !is_num(a[0]->ty)) die("line %d: %s(x) needs a number", e->line, e->call.name);
+        return to;
+    }
+    if (!type_lanes(to)) die("line %d: no conversion to %s", e->line, e->call.name);
+    if (n == 1 && type_lanes(a[0]->ty) == type_lanes(to)) return to;  // int4 <-> float4
+    if (n != 1 && n != type_lanes(to))
+        die("line %d: %s takes 1 or %d values", e->line, e->call.name, type_lanes(to));
+    for (int i=0;i<n;i++)
+        if (!fits(a[i], type_elem(to))) die("line %d: arg %d of %s type", e->line, i+1, e->call.name);
+    return to;
+}
+
+static Type builtin_type(AST_Expr *e) {
+    static const struct { const char *name; Type ty; } convs[] = {
+        { "int", TYPE_INT }, { "string", TYPE_STRING }, { "float", TYPE_FLOAT },
+        { "double", TYPE_DOUBLE }, { "float4", TYPE_FLOAT4 }, { "int4", TYPE_INT4 },
+        { "float8", TYPE_FLOAT8 },
+    };
+    for (size_t i=0;i<sizeof convs/sizeof convs[0];i++)
+        if (!strcmp(e->call.name, convs[i].name)) return builtin_conv(e, convs[i].ty);
+    // hsum, hmin, hmax: fold the lanes of one vector
+    if (e->call.arg_count != 1 || !type_lanes(expr_type(e->call.args[0])))
+        die("line %d: %s takes one vector", e->line, e->call.name);
+    return type_elem(e->call.args[0]->ty);
+}
+
+// doesn't handle type coercion or overloads
+static Type expr_type_(AST_Expr *e) {
     switch (e->kind) {
     case EXPR_INT: return TYPE_INT;
+    case EXPR_FLOAT: return TYPE_DOUBLE;
     case EXPR_STR: return TYPE_STRING;
     case EXPR_IDENT: {
         int idx = find_local(e->ident);
         if (idx==-1) die("undefined var %s", e->ident);  // no forward ref
-        return g.local_ty[idx];
+        if (g.local_len[idx]) return TYPE_ARRAY;  // strict typing rejects bare arrays
+        return g.local_task[idx] ? TYPE_TASK : g.local_ty[idx];
+    }
+    case EXPR_INDEX: {
+        int idx = find_local(e->index.name);
+        if (idx==-1) die("undefined var %s", e->index.name);
+        if (expr_type(e->index.at) != TYPE_INT) die("line %d: index type", e->line);
+        if (!g.local_len[idx] && type_lanes(g.local_ty[idx]) && !g.local_task[idx]) {  // v[i]: a lane
+            e->index.lane = true;
+            e->index.len = type_lanes(g.local_ty[idx]);
+            return type_elem(g.local_ty[idx]);
+        }
+        if (!g.local_len[idx]) die("line %d: %s is not an array", e->line, e->index.name);
+        e->index.len = g.local_len[idx];
+        return g.local_task[idx] ? TYPE_TASK : g.local_ty[idx];
     }
     case EXPR_BIN: {
         Type l = expr_type(e->bin.left), r = expr_type(e->bin.right);
-        if (l!=TYPE_INT || r!=TYPE_INT) die("bin op type");  // strict typing
-        return TYPE_INT;
+        if (l==TYPE_STRING && r==TYPE_STRING && e->bin.op==TOK_PLUS) {
+            // a + b + c is one allocation, inner '+' nodes just contribute parts
+            if (e->bin.left->kind==EXPR_BIN) e->bin.left->chained = true;
+            if (e->bin.right->kind==EXPR_BIN) e->bin.right->chained = true;
+            return TYPE_STRING;
+        }
+        Type t = arith_type(e->bin.left, e->bin.right);
+        if (t == TYPE_VOID) die("line %d: bin op type", e->line);  // strict typing
+        return t;
     }
     case EXPR_CMP: {
         Type l = expr_type(e->cmp.left), r = expr_type(e->cmp.right);
-        if (l!=TYPE_INT || r!=TYPE_INT) die("cmp op type");
+        if (l==TYPE_STRING && r==TYPE_STRING && (e->cmp.cmp==TOK_EQ || e->cmp.cmp==TOK_NE))
+            return TYPE_INT;
+        if (!is_num(arith_type(e->cmp.left, e->cmp.right))) die("line %d: cmp op type", e->line);
         return TYPE_INT;
     }
-    case EXPR_CALL: {
+    case EXPR_CALL: case EXPR_SPAWN: {
         int f = find_func(e->call.name);
-        if (f==-1) die("unknown func %s", e->call.name);  // no forward decls
-        return g.funcs[f].ret_ty;
+        if (f==-1) die("unknown func %s", e->call.name);
+        AST_FuncDecl *fn = &g.funcs[f];
+        if (e->call.arg_count != fn->param_count)
+            die("line %d: %s takes %d args", e->line, fn->name, fn->param_count);
+        for (int i=0;i<e->call.arg_count;i++) {
+            expr_type(e->call.args[i]);
+            if (!fits(e->call.args[i], fn->params[i].type))
+                die("line %d: arg %d of %s type", e->line, i+1, fn->name);
+        }
+        if (e->kind == EXPR_CALL) return fn->ret_ty;
+        // task records are gc memory, aligned for scalars only
+        bool vec = type_lanes(fn->ret_ty);
+        for (int i=0;i<fn->param_count;i++) vec = vec || type_lanes(fn->params[i].type);
+        if (vec) die("line %d: can't spawn %s, tasks don't carry vectors", e->line, fn->name);
+        return TYPE_TASK;
+    }
+    case EXPR_JOIN: {
+        AST_Expr *t = e->join;
+        if (t->kind != EXPR_IDENT && t->kind != EXPR_INDEX)
+            die("line %d: join needs a task variable", e->line);
+        if (expr_type(t) != TYPE_TASK) die("line %d: join of a non-task", e->line);
+        int idx = find_local(t->kind == EXPR_IDENT ? t->ident : t->index.name);
+        if (idx == -1) die("line %d: join needs a task variable", e->line);
+        return g.local_ty[idx];
     }
+    case EXPR_BUILTIN: return builtin_type(e);
     }
     return TYPE_VOID;  // fallback, unreachable if exhaustive
 }
 
+// a task variable only ever holds a spawn of a function returning its type
+static void check_spawn(AST_Expr *e, Type result, const char *name, int line) {
+    if (e->kind != EXPR_SPAWN) die("line %d: task %s can only be set by spawn", line, name);
+    if (g.funcs[find_func(e->call.name)].ret_ty != result)
+        die("line %d: task %s spawns %s, which returns another type", line, name, e->call.name);
+}
+
 // check block semantics
 // doesn't track unreachable code or dead vars
 static void check_block(AST_Block b, Type ret_ty) {
+    int scope = g.local_count;
     for (int i=0;i<b.count;i++) {
         AST_Stmt *s = b.stmts[i];
         switch (s->kind) {
         case STMT_VAR: {
-            if (find_local(s->var.name)!=-1) die("redef var %s", s->var.name);
-            int i = g.local_count++;
-            g.locals = realloc(g.locals, g.local_count*sizeof(char*));       // no null check
-            g.local_ty = realloc(g.local_ty, g.local_count*sizeof(Type));
-            g.local_manual = realloc(g.local_manual, g.local_count*sizeof(bool));
-            g.locals[i] = s->var.name;
-            g.local_ty[i] = s->var.type;
-            g.local_manual[i] = s->var.manual;
-            if (s->var.init) {
-                Type t = expr_type(s->var.init);
-                if (t != s->var.type) die("var init type");  // strict match
+            if (s->var.init) {  // checked first, the var isn't in scope in its own init
+                expr_type(s->var.init);
+                if (s->var.task) check_spawn(s->var.init, s->var.type, s->var.name, s->line);
+                else if (!fits(s->var.init, s->var.type)) die("var init type");  // strict match
             }
+            if (s->var.len && s->var.manual) die("line %d: manual array %s", s->line, s->var.name);
+            add_local(s->var.name, s->var.type, s->var.manual, s->var.task, s->var.len);
             break;
         }
         case STMT_ASSIGN: {
             int idx = find_local(s->assign.name);
             if (idx==-1) die("assign undef %s", s->assign.name);
-            Type t = expr_type(s->assign.expr);
-            if (t != g.local_ty[idx]) die("assign type");
+            Type lhs = s->assign.index ? expr_type(s->assign.index) :
+                       g.local_len[idx] ? TYPE_ARRAY :
+                       g.local_task[idx] ? TYPE_TASK : g.local_ty[idx];
+            if (lhs == TYPE_ARRAY) die("line %d: assign to array %s", s->line, s->assign.name);
+            expr_type(s->assign.expr);
+            if (lhs == TYPE_TASK) check_spawn(s->assign.expr, g.local_ty[idx], s->assign.name, s->line);
+            else if (!fits(s->assign.expr, lhs)) die("assign type");
             break;
         }
         case STMT_IF:
@@ -97,17 +236,36 @@ static void check_block(AST_Block b, Type ret_ty) {
             if (expr_type(s->while_.cond) != TYPE_INT) die("while cond type");
             check_block(s->while_.body, ret_ty);
             break;
-        case STMT_PRINT:
-            expr_type(s->print);  // just check it's valid
+        case STMT_PFOR:  // bounds are evaluated once, before the var exists
+            if (expr_type(s->pfor.lo) != TYPE_INT || expr_type(s->pfor.hi) != TYPE_INT)
+                die("line %d: parallel for bounds type", s->line);
+            add_local(s->pfor.var, TYPE_INT, false, false, 0);
+            check_block(s->pfor.body, ret_ty);
+            g.local_count--;
+            break;
+        case STMT_PRINT: {
+            Type t = expr_type(s->print);
+            if (t == TYPE_VOID || t == TYPE_ARRAY || t == TYPE_TASK) die("line %d: print type", s->line);
             break;
+        }
+        case STMT_EXPR:
+            expr_type(s->expr);  // result discarded
+            break;
+        case STMT_FREE: {
+            int idx = find_local(s->free_);
+            if (idx==-1) die("free undef %s", s->free_);
+            if (!g.local_manual[idx]) die("line %d: free of non-manual var %s", s->line, s->free_);
+            break;
+        }
         case STMT_RETURN:
             if (s->ret) {
-                Type t = expr_type(s->ret);
-                if (t != ret_ty) die("return type");
+                expr_type(s->ret);
+                if (!fits(s->ret, ret_ty)) die("return type");
             }
             break;
         }
     }
+    g.local_count = scope;
 }
 
 // entry point for semantic analysis
@@ -115,10 +273,17 @@ static void check_block(AST_Block b, Type ret_ty) {
 void sema_check(AST_Program *p) {
     g.funcs = p->funcs;
     g.func_count = p->func_count;
-    g.locals = NULL; g.local_count = 0;
-    if (find_func("main")==-1) die("no main");  // ensure entry point
+    int m = find_func("main");
+    if (m==-1) die("no main");  // ensure entry point
+    // the c main calls kl_main() and returns what it gives
+    if (g.funcs[m].param_count || g.funcs[m].ret_ty != TYPE_INT)
+        die("line %d: main must be func main() -> int", g.funcs[m].line);
     for (int i=0;i<g.func_count;i++) {
         AST_FuncDecl *f = &g.funcs[i];
+        g.local_count = 0;  // params open the function scope
+        for (int j=0;j<f->param_count;j++) add_local(f->params[j].name, f->params[j].type, false, false, 0);
         check_block(f->body, f->ret_ty);  // validate body
     }
+    parallel_check(p);
+    escape_analyze(p);
 }
\ No newline at end of file
@@ -1,3 +1,5 @@
 #pragma once
 #include "../ast/ast.h"
-void sema_check(AST_Program *p);
\ No newline at end of file
+void sema_check(AST_Program *p);
+void escape_analyze(AST_Program *p);  // run by sema_check, needs expr types
+void parallel_check(AST_Program *p);  // run by sema_check, fills in parallel for captures